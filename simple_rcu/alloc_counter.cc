@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "simple_rcu/alloc_counter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Allocations made by the current thread.
+thread_local uint64_t thread_allocations = 0;
+
+void *Allocate(size_t size) noexcept {
+  thread_allocations++;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *AllocateOrThrow(size_t size) {
+  if (void *ptr = Allocate(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+#ifdef __cpp_aligned_new
+void *AllocateAligned(size_t size, std::align_val_t alignment) noexcept {
+  thread_allocations++;
+  const size_t align = static_cast<size_t>(alignment);
+  // `aligned_alloc` requires a non-zero multiple of the alignment.
+  return std::aligned_alloc(align,
+                            ((size == 0 ? 1 : size) + align - 1) & ~(align - 1));
+}
+
+void *AllocateAlignedOrThrow(size_t size, std::align_val_t alignment) {
+  if (void *ptr = AllocateAligned(size, alignment)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+#endif  // __cpp_aligned_new
+
+}  // namespace
+
+namespace simple_rcu {
+
+uint64_t ThreadAllocations() noexcept { return thread_allocations; }
+
+}  // namespace simple_rcu
+
+void *operator new(size_t size) { return AllocateOrThrow(size); }
+void *operator new[](size_t size) { return AllocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+#ifdef __cpp_aligned_new
+void *operator new(size_t size, std::align_val_t alignment) {
+  return AllocateAlignedOrThrow(size, alignment);
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return AllocateAlignedOrThrow(size, alignment);
+}
+void *operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return AllocateAligned(size, alignment);
+}
+void *operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+#endif  // __cpp_aligned_new
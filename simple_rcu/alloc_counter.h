@@ -0,0 +1,33 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _SIMPLE_RCU_ALLOC_COUNTER_H
+#define _SIMPLE_RCU_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+namespace simple_rcu {
+
+// Returns the number of heap allocations made by the current thread so far.
+//
+// Counted by replacements of all forms of the global `operator new` in
+// `alloc_counter.cc`, so it only works in programs that link `alloc_counter`,
+// such as the allocation benchmarks. Each allocation is just counted and
+// forwarded to `malloc` (or `aligned_alloc`).
+uint64_t ThreadAllocations() noexcept;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_ALLOC_COUNTER_H
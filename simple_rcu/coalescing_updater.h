@@ -0,0 +1,167 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_COALESCING_UPDATER_H
+#define _SIMPLE_RCU_COALESCING_UPDATER_H
+
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+
+// Statistics of a `CoalescingUpdater`, as returned by its `Stats()` method.
+// All counters are totals since it was constructed.
+struct CoalescingStats {
+  // Values passed to `Publish`.
+  uint_fast64_t published;
+  // Values distributed to `View`s by `CopyRcu::Update`.
+  uint_fast64_t updates;
+  // Values replaced by a later one before being distributed.
+  uint_fast64_t coalesced;
+};
+
+// Updates a `CopyRcu` asynchronously from a background thread, coalescing
+// bursts of values.
+//
+// `Publish` only stores its value, replacing any value that hasn't been
+// distributed yet, and returns. The background thread distributes the latest
+// value by `CopyRcu::Update`, at most once per `min_interval` (measured
+// between the starts of successive updates), and otherwise as soon as the
+// previous update finishes. So a storm of published values costs a bounded
+// number of fan-outs to all `View`s, and `View`s lag behind the latest value
+// by at most `min_interval` plus the duration of an update.
+//
+// Compared to `CopyRcu::UpdateLatest`, which also skips superseded values,
+// the fan-out never runs on the publishing thread and its rate is limited.
+//
+// Thread-safe.
+template <typename T, typename Policy = NoStats>
+class CoalescingUpdater final {
+ public:
+  using Rcu = CopyRcu<T, Policy>;
+
+  // Argument `rcu` must outlive this instance.
+  CoalescingUpdater(Rcu &rcu,
+                    absl::Duration min_interval = absl::ZeroDuration())
+      : rcu_(rcu),
+        min_interval_(min_interval),
+        lock_(),
+        pending_(),
+        stopping_(false),
+        flushing_(0),
+        updated_(0),
+        stats_{0, 0, 0},
+        thread_([this]() { Run(); }) {}
+  CoalescingUpdater(const CoalescingUpdater &) = delete;
+  CoalescingUpdater &operator=(const CoalescingUpdater &) = delete;
+
+  // Distributes the pending value, if any, regardless of `min_interval`.
+  ~CoalescingUpdater() ABSL_LOCKS_EXCLUDED(lock_) {
+    {
+      absl::MutexLock lock(&lock_);
+      stopping_ = true;
+    }
+    thread_.join();
+  }
+
+  // Makes `value` the next value to be distributed, replacing any previous
+  // one that hasn't been distributed yet. Never waits for an update.
+  void Publish(typename Rcu::MutableT value) ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::optional<typename Rcu::MutableT> superseded;
+    absl::MutexLock lock(&lock_);
+    if (pending_.has_value()) {
+      stats_.coalesced++;
+      // Destroyed by the publishing thread after releasing `lock_`.
+      superseded = std::move(pending_);
+    }
+    pending_.emplace(std::move(value));
+    stats_.published++;
+  }
+
+  // Waits until the value of the last `Publish` that returned before this
+  // call (or a later one) has been distributed to all `View`s. Distributes it
+  // right away regardless of `min_interval`.
+  void Flush() ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    const uint_fast64_t target = stats_.published;
+    flushing_++;
+    auto flushed = [this, target]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return updated_ >= target;
+    };
+    lock_.Await(absl::Condition(&flushed));
+    flushing_--;
+  }
+
+  CoalescingStats Stats() const ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    return stats_;
+  }
+
+ private:
+  void Run() ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::Time next_update = absl::InfinitePast();
+    absl::MutexLock lock(&lock_);
+    while (true) {
+      auto has_value = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+        return stopping_ || pending_.has_value();
+      };
+      lock_.Await(absl::Condition(&has_value));
+      // Rate-limit, unless a value is needed right away.
+      auto urgent = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+        return stopping_ || flushing_ > 0;
+      };
+      lock_.AwaitWithDeadline(absl::Condition(&urgent), next_update);
+      if (!pending_.has_value()) {
+        return;  // `stopping_`.
+      }
+      typename Rcu::MutableT value = *std::move(pending_);
+      pending_.reset();
+      const uint_fast64_t published = stats_.published;
+      lock_.Unlock();
+      next_update = absl::Now() + min_interval_;
+      rcu_.Update(std::move(value));
+      lock_.Lock();
+      updated_ = published;
+      stats_.updates++;
+    }
+  }
+
+  Rcu &rcu_;
+  const absl::Duration min_interval_;
+  mutable absl::Mutex lock_;
+  // The latest published value, if it hasn't been taken by `Run` yet.
+  absl::optional<typename Rcu::MutableT> pending_ ABSL_GUARDED_BY(lock_);
+  bool stopping_ ABSL_GUARDED_BY(lock_);
+  // The number of `Flush` calls waiting.
+  int flushing_ ABSL_GUARDED_BY(lock_);
+  // The number of the last value distributed by `Run`, counting values by
+  // `stats_.published`.
+  uint_fast64_t updated_ ABSL_GUARDED_BY(lock_);
+  CoalescingStats stats_ ABSL_GUARDED_BY(lock_);
+  // Runs `Run`. Declared last, so that it starts after all other members are
+  // initialized.
+  std::thread thread_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_COALESCING_UPDATER_H
@@ -0,0 +1,103 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/coalescing_updater.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::Pointee;
+
+TEST(CoalescingUpdaterTest, PublishAndFlush) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View reader(rcu);
+  CoalescingUpdater<int> updater(rcu);
+  updater.Publish(1);
+  updater.Flush();
+  EXPECT_EQ(*reader.Read(), 1);
+  updater.Publish(2);
+  updater.Publish(3);
+  updater.Flush();
+  EXPECT_EQ(*reader.Read(), 3) << "Must always distribute the latest value";
+  const CoalescingStats stats = updater.Stats();
+  EXPECT_EQ(stats.published, 3u);
+  EXPECT_EQ(stats.updates + stats.coalesced, stats.published);
+}
+
+TEST(CoalescingUpdaterTest, CoalescesWithinInterval) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View reader(rcu);
+  CoalescingUpdater<int> updater(rcu, absl::Hours(1));
+  updater.Publish(1);
+  updater.Flush();
+  // The next update is due only in an hour, so all these values pile up.
+  for (int i = 2; i <= 100; i++) {
+    updater.Publish(i);
+  }
+  CoalescingStats stats = updater.Stats();
+  EXPECT_EQ(stats.updates, 1u);
+  EXPECT_EQ(stats.coalesced, 98u);
+  EXPECT_EQ(*reader.Read(), 1);
+  updater.Flush();
+  EXPECT_EQ(*reader.Read(), 100) << "Flush must ignore the interval";
+  stats = updater.Stats();
+  EXPECT_EQ(stats.updates, 2u);
+  EXPECT_EQ(stats.published, 100u);
+}
+
+TEST(CoalescingUpdaterTest, DestructionDistributesPendingValue) {
+  Rcu<int> rcu;
+  Rcu<int>::View reader(rcu);
+  {
+    CoalescingUpdater<std::shared_ptr<const int>> updater(rcu, absl::Hours(1));
+    updater.Publish(std::make_shared<int>(1));
+    updater.Flush();
+    updater.Publish(std::make_shared<int>(2));
+  }
+  EXPECT_THAT(reader.ReadPtr(), Pointee(2));
+}
+
+TEST(CoalescingUpdaterTest, ConcurrentPublishers) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View reader(rcu);
+  CoalescingUpdater<int> updater(rcu, absl::Microseconds(100));
+  std::vector<std::thread> publishers;
+  for (int i = 0; i < 4; i++) {
+    publishers.emplace_back([&updater]() {
+      for (int j = 1; j <= 1000; j++) {
+        updater.Publish(j);
+      }
+    });
+  }
+  for (auto &publisher : publishers) {
+    publisher.join();
+  }
+  updater.Flush();
+  EXPECT_EQ(*reader.Read(), 1000) << "Every publisher ends with 1000";
+  const CoalescingStats stats = updater.Stats();
+  EXPECT_EQ(stats.published, 4000u);
+  EXPECT_EQ(stats.updates + stats.coalesced, stats.published);
+}
+
+}  // namespace
+}  // namespace simple_rcu
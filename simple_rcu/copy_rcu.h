@@ -15,50 +15,178 @@
 #ifndef _SIMPLE_RCU_COPY_RCU_H
 #define _SIMPLE_RCU_COPY_RCU_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <new>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/base/thread_annotations.h"
-#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/absl_log.h"
-#include "absl/memory/memory.h"
+#include "absl/meta/type_traits.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
-#include "absl/types/variant.h"
 #include "simple_rcu/local_3state_rcu.h"
+#include "simple_rcu/rcu_stats.h"
+#include "simple_rcu/spin_lock.h"
 #include "simple_rcu/thread_local.h"
+#include "simple_rcu/tracing.h"
 
 namespace simple_rcu {
 
-// Generic, user-space RCU implementation with fast, atomic, lock-free reads.
+class CopyRcuGroup;
+
+// Policies for the `Policy` template parameter of `CopyRcu`, selected at
+// compile time so that each configuration is built without branches for the
+// others:
 //
-// `T` must be copyable.
+// - `Stats` is `NoStats` or `WithStats`, see `CopyRcu::Stats()`.
+// - `Layout` is the layout of the `Local3StateRcu` of each `View`, see
+//   `CompactLayout` and `CacheLinePaddedLayout`. Padding avoids false sharing
+//   between a reader and the updater, which matters with frequent updates.
+// - `UpdateMutex` serializes updates. It must provide `Lock()`, `TryLock()`
+//   and `Unlock()`, such as `absl::Mutex` or `SpinLock`, which is cheaper
+//   when updates are short and rarely contended, but never blocks waiters.
+//
+// `NoStats` and `WithStats` can be passed directly as well, which keeps the
+// defaults for the other policies.
+template <typename Stats = NoStats, typename LayoutPolicy = CompactLayout,
+          typename UpdateMutexPolicy = absl::Mutex>
+struct CopyRcuPolicy : public Stats {
+  using Layout = LayoutPolicy;
+  using UpdateMutex = UpdateMutexPolicy;
+};
+
+// Resolves the policies of a `Policy` argument of `CopyRcu`, defaulting those
+// it doesn't define.
+template <typename Policy, typename = void>
+struct CopyRcuLayoutOf {
+  using type = CompactLayout;
+};
+template <typename Policy>
+struct CopyRcuLayoutOf<Policy, absl::void_t<typename Policy::Layout>> {
+  using type = typename Policy::Layout;
+};
+template <typename Policy, typename = void>
+struct CopyRcuUpdateMutexOf {
+  using type = absl::Mutex;
+};
+template <typename Policy>
+struct CopyRcuUpdateMutexOf<Policy,
+                            absl::void_t<typename Policy::UpdateMutex>> {
+  using type = typename Policy::UpdateMutex;
+};
+
+// Generic, user-space RCU implementation with fast, atomic, lock-free reads.
 //
 // Copies of objects of type `T` are distributed to thread-local receivers.
-template <typename T>
+//
+// `T` must be movable. If it isn't copyable, values are constructed separately
+// for each receiver by a factory function instead, see the constructor and
+// `Update` taking `make`. In this case the methods that take a `T` value
+// aren't available.
+//
+// `Policy` is either `NoStats` or `WithStats`, see `Stats()`, or a
+// `CopyRcuPolicy` that additionally selects the layout and the update lock.
+template <typename T, typename Policy = NoStats>
 class CopyRcu {
  public:
   using MutableT = typename std::remove_const<T>::type;
   class View;
+  class Pinned;
 
-  static_assert(std::is_copy_constructible<MutableT>::value &&
-                    std::is_copy_assignable<MutableT>::value,
-                "T must be copy constructible and assignable");
+  // Constructs new instances of a value, each time an equal one.
+  using Factory = std::function<MutableT()>;
+  // Selects overloads taking a `Factory` only for arguments that aren't
+  // values, such as `nullptr` for a `shared_ptr`.
+  template <typename F>
+  using EnableIfFactory =
+      typename std::enable_if<!std::is_convertible<F, MutableT>::value &&
+                              std::is_convertible<F, Factory>::value>::type;
 
+  // Move-only smart pointer to a value held by a `View`, as returned by
+  // `View::Read()` (with `U = T`) and `View::ReadPtr()` (with `U` being the
+  // `element_type` of `T`).
+  //
+  // It consists of just a pointer to its `View`, which keeps both the value and
+  // the nesting depth of its snapshots. So it's as cheap to pass around as a
+  // raw pointer and releasing it is a single decrement, with no deleter to
+  // call.
+  //
+  // A moved-from instance may only be destroyed or assigned to.
   template <typename U = T>
-  class SnapshotDeleter {
+  class SnapshotPtr final {
    public:
-    SnapshotDeleter(const SnapshotDeleter &) noexcept = default;
-    SnapshotDeleter &operator=(const SnapshotDeleter &) noexcept = default;
+    using element_type = U;
 
-    void operator()(U *) { registrar_.snapshot_depth_--; }
+    SnapshotPtr(SnapshotPtr &&other) noexcept : view_(other.view_) {
+      other.view_ = nullptr;
+    }
+    SnapshotPtr &operator=(SnapshotPtr &&other) noexcept {
+      if (this != &other) {
+        Release();
+        view_ = other.view_;
+        other.view_ = nullptr;
+      }
+      return *this;
+    }
+    ~SnapshotPtr() noexcept { Release(); }
+
+    // For `ReadPtr()` this is `nullptr` if the `shared_ptr` is.
+    U *get() const noexcept {
+      return Get(std::is_same<typename std::remove_const<U>::type,
+                              MutableT>());
+    }
+    U &operator*() const noexcept { return *get(); }
+    U *operator->() const noexcept { return get(); }
+    explicit operator bool() const noexcept { return get() != nullptr; }
+
+    // The version of the value held by the snapshot, see `Version()`.
+    uint_fast64_t version() const noexcept { return view_->current_->version; }
+
+    friend bool operator==(const SnapshotPtr &a, const SnapshotPtr &b) {
+      return a.get() == b.get();
+    }
+    friend bool operator!=(const SnapshotPtr &a, const SnapshotPtr &b) {
+      return a.get() != b.get();
+    }
+    friend bool operator==(const SnapshotPtr &a, std::nullptr_t) {
+      return a.get() == nullptr;
+    }
+    friend bool operator!=(const SnapshotPtr &a, std::nullptr_t) {
+      return a.get() != nullptr;
+    }
 
    private:
-    SnapshotDeleter(View &registrar) noexcept : registrar_(registrar) {}
+    // Must be called only after incrementing `view.snapshot_depth_`.
+    explicit SnapshotPtr(View &view) noexcept : view_(&view) {}
+
+    void Release() noexcept {
+      if (view_ != nullptr) {
+        view_->snapshot_depth_--;
+        SIMPLE_RCU_TRACE(SnapshotRelease, view_, view_->snapshot_depth_);
+      }
+    }
+
+    U *Get(std::true_type) const noexcept { return &view_->current_->value; }
+    U *Get(std::false_type) const noexcept {
+      return view_->current_->value.get();
+    }
 
-    View &registrar_;
+    View *view_;
 
     friend class View;
   };
@@ -67,28 +195,42 @@ class CopyRcu {
   // The reference is guaranteed to be stable during the lifetime of `Snapshot`.
   // Callers are expected to limit the lifetime of `Snapshot` to as short as
   // possible.
-  // WARNING: Bad things will happen if you use `reset` on a `Snapshot`.
+  // The version of the value is `snapshot.version()`.
   // Thread-compatible (but not thread-safe), reentrant.
-  using Snapshot = std::unique_ptr<T, SnapshotDeleter<>>;
+  using Snapshot = SnapshotPtr<>;
 
   // Interface to the RCU local to a particular reader thread.
   // Construction and destruction are thread-safe operations, but the `Read()`
   // (and `ReadPtr()`) methods are only thread-compatible. Callers are expected
   // to construct a separate `View` instance for each reader thread.
+  //
+  // With executors that multiplex many tasks (such as coroutines or fibers)
+  // over a few threads, use a `View` per executor thread rather than per task,
+  // so that updates fan out only to the threads. A `Snapshot` must then not be
+  // held across a suspension point, since the task may resume on another
+  // thread. Use `Pin()` for values that need to be held across suspension.
   class View final {
    public:
-    // Thread-safe. Argument `rcu` must outlive this instance.
-    // Acquires a mutex to register (and deregister in `~Local`) in `rcu`,
-    // therefore it'll block waiting on the mutex if a concurrent call to
-    // `Update` is running.
+    // Thread-safe. The `View` may outlive `rcu`, in which case it keeps its
+    // last received value.
+    // Registration acquires only a short-lived internal lock that is never
+    // held while `Update` distributes values to `View` instances, so it
+    // doesn't wait for a concurrently running `Update`. It may wait for
+    // another `View` copying the current value, see `Read()`. Destruction
+    // doesn't acquire any lock at all.
     View(CopyRcu &rcu)
-        : snapshot_depth_(0), local_(rcu, absl::MutexLock(&rcu.lock_)) {}
-    View(std::shared_ptr<CopyRcu> rcu)
-        : snapshot_depth_(0), local_(rcu, absl::MutexLock(&rcu->lock_)) {}
+        : snapshot_depth_(0),
+          local_(rcu.Register()),
+          current_(&local_->local_rcu.Read()) {}
+    View(const std::shared_ptr<CopyRcu> &rcu) : View(*rcu) {}
+    ~View() { local_->abandoned.store(true, std::memory_order_release); }
 
     // Obtains a read snapshot to the current value held by the RCU.
     // Never returns `nullptr`.
-    // This is a very fast, lock-free and atomic operation.
+    // This is a very fast, lock-free and atomic operation, unless updates
+    // have skipped this `View` because it hadn't read the previous value. Then
+    // it copies the current value itself, while holding a short-lived internal
+    // lock that is never held while `Update` distributes values.
     // Thread-compatible, but not thread-safe.
     //
     // Reentrancy: Each call to `Read()` increments an internal reference
@@ -97,14 +239,9 @@ class CopyRcu {
     // RCU. Subsequent nested calls to `Read()` return the same value. This
     // mechanism ensures that the value of a `Snapshot` is not changed by such
     // nested calls.
-    //
-    // WARNING: Do not use `reset` or `release` on the returned `unique_ptr`.
-    // Doing so is likely to lead to undefined behavior.
     Snapshot Read() noexcept {
-      if (snapshot_depth_++ == 0) {
-        local_.local_rcu.TryRead();
-      }
-      return Snapshot(&local_.local_rcu.Read(), SnapshotDeleter<>(*this));
+      Acquire();
+      return Snapshot(*this);
     }
 
     // In case `T` is a `std::shared_ptr`, `ReadPtr` provides convenient access
@@ -115,69 +252,345 @@ class CopyRcu {
     // internal reference counting or invoking `~T`. Rather the pointer is
     // destroyed by the updater thread during one of the subsequent `Update`
     // passes.
+    //
+    // If the pointer is `nullptr`, so is the result, which nevertheless keeps
+    // the value from advancing like any other snapshot until it's destroyed.
     template <typename U = T>
-    std::unique_ptr<typename U::element_type,
-                    SnapshotDeleter<typename U::element_type>>
-    ReadPtr() noexcept {
+    SnapshotPtr<typename U::element_type> ReadPtr() noexcept {
+      Acquire();
+      return SnapshotPtr<typename U::element_type>(*this);
+    }
+
+    // Obtains a copy of the current value, which unlike a `Snapshot` may be
+    // held by any thread, for example by a task migrating between executor
+    // threads, and is also waited for by `WaitForReaders` and `Synchronize`.
+    // Afterwards this `View` continues advancing to new values as usual.
+    //
+    // More expensive than `Read()`: It copies the value (for `Rcu<T>` that's
+    // just incrementing the reference count of a `shared_ptr`) and performs a
+    // few atomic read-modify-write operations. Available only if `T` is
+    // copyable.
+    // Thread-compatible, but not thread-safe, like `Read()`.
+    Pinned Pin() {
+      // The pin is counted before reading the value, see `WaitForPins`.
+      const uint_fast8_t phase =
+          local_->pin_phase.load(std::memory_order_seq_cst);
+      local_->pins[phase].fetch_add(1, std::memory_order_seq_cst);
       Snapshot snapshot = Read();
-      if (*snapshot == nullptr) {
-        // For a `nullptr` there is no value to keep. Therefore we can just let
-        // `snapshot` get deleted and create a `nullptr`, which won't invoke
-        // its deleter.
-        return {nullptr, SnapshotDeleter<typename U::element_type>(*this)};
-      } else {
-        return {snapshot.release()->get(),
-                SnapshotDeleter<typename U::element_type>(*this)};
+      return Pinned(local_, phase, *snapshot, snapshot.version());
+    }
+
+    // Blocks until a new value is available, that is, until the outermost
+    // `Read()` would advance, or until `timeout` expires. Returns whether a new
+    // value is available. Doesn't advance by itself.
+    //
+    // Waiting costs nothing to `Read()` and very little to updates when no
+    // `View` is waiting: The `View` marks its `Local3StateRcu` as waiting, and
+    // only an update that finds the mark wakes it up.
+    // Thread-compatible, but not thread-safe, like `Read()`.
+    bool WaitForUpdate(absl::Duration timeout = absl::InfiniteDuration()) {
+      Local &local = *local_;
+      absl::MutexLock lock(&local.wait_lock);
+      if (!local.local_rcu.MarkReadWaiting() || local.PullRequested()) {
+        return true;
       }
+      const absl::Time deadline = absl::Now() + timeout;
+      while (local.local_rcu.ReadWaiting()) {
+        if (local.updated.WaitWithDeadline(&local.wait_lock, deadline)) {
+          return !local.local_rcu.ReadWaiting();
+        }
+      }
+      return true;
     }
 
-   private:
-    // Holds a `Local3StateRcu<MutableT>` and maintains its registration in
-    // `CopyRcu`.
-    struct Local {
-     public:
-      // The constructors are designed to accept a `MutexLock` to ensure the
-      // whole object becomes protected during its construction. This way
-      // `CopyRcu` will never observe a partially constructed `Local` instance.
-      Local(CopyRcu &rcu_, const absl::MutexLock &)
-          // ABSL_EXCLUSIVE_LOCKS_REQUIRED(rcu_.lock_)
-          : local_rcu(rcu_.RegisterLocked(*this)), rcu(&rcu_) {
-        rcu_.lock_.AssertHeld();
+    // Calls `callback` once a new value is available, see `WaitForUpdate()`.
+    // If one is available already, calls it right away. Otherwise it's called
+    // by the thread distributing the next value, while holding the internal
+    // update lock, so it must be fast and must not update this `CopyRcu`.
+    // Typically it resumes or schedules a task that then calls `Read()`.
+    // Replaces any previously registered `callback` that hasn't been called
+    // yet.
+    // Thread-compatible, but not thread-safe, like `Read()`.
+    void NotifyOnUpdate(std::function<void()> callback) {
+      {
+        Local &local = *local_;
+        absl::MutexLock lock(&local.wait_lock);
+        if (local.local_rcu.MarkReadWaiting() && !local.PullRequested()) {
+          local.on_update = std::move(callback);
+          return;
+        }
       }
-      Local(std::shared_ptr<CopyRcu> rcu_, const absl::MutexLock &)
-          // ABSL_EXCLUSIVE_LOCKS_REQUIRED(rcu_->lock_)
-          : local_rcu(rcu_->RegisterLocked(*this)), rcu(rcu_) {
-        rcu_->lock_.AssertHeld();
+      callback();
+    }
+
+   private:
+    // Increments `snapshot_depth_`, advancing to a new value (if any) for the
+    // outermost snapshot.
+    void Acquire() noexcept {
+      SIMPLE_RCU_TRACE(ReadBegin, this, snapshot_depth_);
+      if (snapshot_depth_++ == 0) {
+        bool advanced = local_->local_rcu.TryRead();
+        // Claimed before accessing `rcu`, which might be destroyed otherwise.
+        const uint_fast64_t requested = local_->ClaimPull();
+        if (ABSL_PREDICT_FALSE(requested != Local::kNoPull)) {
+          advanced |= local_->rcu.Pull(*local_, requested);
+        }
+        local_->RecordRead(advanced);
+        current_ = &local_->local_rcu.Read();
       }
-      ~Local() {
-        CopyRcu *const *ptr = absl::get_if<0>(&rcu);
-        if (ptr != nullptr) {
-          (*ptr)->Unregister(*this);
-        } else {
-          const std::shared_ptr<CopyRcu> rcu_ptr = absl::get<1>(rcu).lock();
-          if (rcu_ptr != nullptr) {
-            rcu_ptr->Unregister(*this);
+      SIMPLE_RCU_TRACE(ReadEnd, this, current_->version);
+    }
+
+    // Like `Read()`, but keeps the current value even if a new one is
+    // available.
+    Snapshot ReadCurrent() noexcept {
+      snapshot_depth_++;
+      return Snapshot(*this);
+    }
+
+    // Holds a `Local3StateRcu` shared by a `View` and the registry of its
+    // `CopyRcu`. The `View` is the Reader, the thread holding `CopyRcu::lock_`
+    // is the Updater.
+    //
+    // Since the registry holds a `shared_ptr` as well, a `View` can go away
+    // while an `Update` is distributing a value to its `Local`. Instances
+    // without a `View` are collected by the following `Update`.
+    //
+    // If the `View` hasn't read the value pushed previously, an `Update`
+    // doesn't copy its value into `local_rcu` at all. Instead, it sets
+    // `pull_version` and the `View` pulls the current value (a single copy,
+    // however many updates it missed) on its next `Read()`, see `Pull`.
+    //
+    // Inherits the counters of the stats policy written by the `View`, so that
+    // they take no space with `NoStats`.
+    struct Local : public Policy::Reader {
+      // A copy of `CopyRcu::value_` at `CopyRcu::version_` equal to `version`.
+      struct Versioned {
+        MutableT value;
+        uint_fast64_t version;
+      };
+
+      // No pull requested.
+      static constexpr uint_fast64_t kNoPull = 0;
+      // Set by `Pull` while it's running.
+      static constexpr uint_fast64_t kPulling =
+          std::numeric_limits<uint_fast64_t>::max();
+
+      Local(CopyRcu &rcu_, const MutableT &value, uint_fast64_t version)
+          : local_rcu(Versioned{value, version}),
+            rcu(rcu_),
+            pull_version(kNoPull),
+            abandoned(false),
+            pin_phase(0),
+            pins{{0}, {0}},
+            wait_lock(),
+            updated(),
+            on_update() {}
+      Local(CopyRcu &rcu_, const Factory &make, uint_fast64_t version)
+          : local_rcu(Versioned{make(), version}, Versioned{make(), version},
+                      Versioned{make(), version}),
+            rcu(rcu_),
+            pull_version(kNoPull),
+            abandoned(false),
+            pin_phase(0),
+            pins{{0}, {0}},
+            wait_lock(),
+            updated(),
+            on_update() {}
+
+      Local3StateRcu<Versioned, typename CopyRcuLayoutOf<Policy>::type>
+          local_rcu;
+      // Accessed by the `View` only while it has claimed a pull, which
+      // `~CopyRcu` waits for, since the `View` may outlive `rcu`.
+      CopyRcu &rcu;
+      // The version of an update that has requested the `View` to pull the
+      // current value, or `kNoPull`, or `kPulling`.
+      std::atomic<uint_fast64_t> pull_version;
+      // Set by `~View`. The instance itself may still be kept alive by the
+      // `View`'s `Pinned` values.
+      std::atomic<bool> abandoned;
+      // Live `Pinned` instances of this `View`, counted in `pins[phase]` by
+      // the `pin_phase` at their creation. See `WaitForPins`.
+      std::atomic<uint_fast8_t> pin_phase;
+      std::atomic<uint_fast32_t> pins[2];
+      // Guards waking up a `WaitForUpdate` through `updated` and taking
+      // `on_update`.
+      absl::Mutex wait_lock;
+      absl::CondVar updated;
+      std::function<void()> on_update ABSL_GUARDED_BY(wait_lock);
+
+      // Called by the Updater instead of `local_rcu.ForceUpdate()`. Notifies
+      // the `View` only if it's waiting, keeping the common path to a single
+      // atomic exchange.
+      bool ForceUpdate() {
+        bool reader_waiting = false;
+        const bool read = local_rcu.ForceUpdate(&reader_waiting);
+        if (ABSL_PREDICT_FALSE(reader_waiting)) {
+          std::function<void()> callback;
+          {
+            absl::MutexLock lock(&wait_lock);
+            updated.Signal();
+            callback.swap(on_update);
+          }
+          if (callback) {
+            callback();
           }
         }
+        return read;
+      }
+
+      // Called by the `View`: If an update has requested a pull, sets
+      // `pull_version` to `kPulling` and returns the requested version.
+      // Otherwise returns `kNoPull`. Touches only this instance, so it's safe
+      // even if `rcu` has been destroyed.
+      uint_fast64_t ClaimPull() noexcept {
+        uint_fast64_t requested = pull_version.load(std::memory_order_relaxed);
+        do {
+          if (ABSL_PREDICT_TRUE(requested == kNoPull)) {
+            return kNoPull;
+          }
+        } while (!pull_version.compare_exchange_weak(
+            requested, kPulling, std::memory_order_acquire));
+        return requested;
       }
 
-      Local3StateRcu<MutableT> local_rcu;
-      const absl::variant<CopyRcu *, const std::weak_ptr<CopyRcu>> rcu;
+      // Called by the `View` after marking `local_rcu` as waiting. Pairs
+      // with the fence in `DeferPush`: Either the Updater observes the mark
+      // and pushes a value, or this observes its `pull_version`.
+      bool PullRequested() const noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return pull_version.load(std::memory_order_relaxed) != kNoPull;
+      }
     };
 
     // Incremented with each `Snapshot` instance. Ensures that `TryRead` is
     // invoked only for the outermost `Snapshot`, keeping its value unchanged
     // for its whole lifetime.
     int_fast16_t snapshot_depth_;
-    Local local_;
+    const std::shared_ptr<Local> local_;
+    // Always `&local_->local_rcu.Read()`, cached for `SnapshotPtr`.
+    typename Local::Versioned *current_;
 
     friend class CopyRcu;
+    friend class CopyRcuGroup;
+    friend class Pinned;
+    template <typename U>
+    friend class SnapshotPtr;
+  };
+
+  // A copy of a value obtained by `View::Pin()`, which keeps its version
+  // pinned: `WaitForReaders` (and `Synchronize`) wait until all `Pinned`
+  // instances that exist when they're called are destroyed, like a grace
+  // period of classic RCU waits for all pre-existing read-side sections.
+  //
+  // Not tied to the thread of its `View`, so it can be held across suspension
+  // points of coroutines or fibers and destroyed by any thread.
+  // A `View` destroyed while it has `Pinned` instances no longer holds back
+  // `ReadersPassed`, but its `Pinned` instances are still waited for by
+  // `WaitForReaders` until they're destroyed.
+  // A moved-from instance may only be destroyed or assigned to.
+  // Thread-compatible.
+  class Pinned final {
+   public:
+    Pinned(Pinned &&other) noexcept
+        : local_(std::move(other.local_)),
+          phase_(other.phase_),
+          value_(std::move(other.value_)),
+          version_(other.version_) {}
+    Pinned &operator=(Pinned &&other) noexcept {
+      if (this != &other) {
+        Unpin();
+        local_ = std::move(other.local_);
+        phase_ = other.phase_;
+        value_ = std::move(other.value_);
+        version_ = other.version_;
+      }
+      return *this;
+    }
+    ~Pinned() noexcept { Unpin(); }
+
+    const MutableT &operator*() const noexcept { return value_; }
+    const MutableT *operator->() const noexcept { return &value_; }
+
+    // The version of the pinned value, see `Version()`.
+    uint_fast64_t version() const noexcept { return version_; }
+
+   private:
+    Pinned(std::shared_ptr<typename View::Local> local, uint_fast8_t phase,
+           const MutableT &value, uint_fast64_t version)
+        : local_(std::move(local)),
+          phase_(phase),
+          value_(value),
+          version_(version) {}
+
+    void Unpin() noexcept {
+      if (local_ != nullptr) {
+        local_->pins[phase_].fetch_sub(1, std::memory_order_release);
+        local_ = nullptr;
+      }
+    }
+
+    std::shared_ptr<typename View::Local> local_;
+    uint_fast8_t phase_;
+    MutableT value_;
+    uint_fast64_t version_;
+
+    friend class View;
+  };
+
+  // Configures distributing values to `View` instances in parallel. Useful
+  // when there are thousands of them.
+  struct ShardedFanOut {
+    // Runs `shard(i)` for each `i` in [0, `shards`), possibly in parallel,
+    // and returns after all of them have finished. See for example
+    // `FanOutPool::Executor()`.
+    using Executor =
+        std::function<void(size_t shards, absl::FunctionRef<void(size_t)>)>;
+
+    // The number of `View` instances updated by a single `shard` call. If
+    // there are at most this many `View`s, they're updated directly by the
+    // calling thread.
+    size_t shard_size;
+    // If empty, all `View` instances are updated by the calling thread.
+    Executor executor;
   };
 
   // Constructs a RCU with an initial value `T()`.
   CopyRcu() : CopyRcu(T()) {}
   explicit CopyRcu(T initial_value)
-      : lock_(), value_(std::move(initial_value)), locals_() {}
+      : CopyRcu(std::move(initial_value), ShardedFanOut{0, nullptr}) {}
+  // Constructs a RCU that distributes values in parallel using `fan_out`.
+  CopyRcu(T initial_value, ShardedFanOut fan_out)
+      : id_(NewId()),
+        sharded_fan_out_(std::move(fan_out)),
+        lock_(),
+        fan_out_(),
+        pending_(nullptr),
+        history_(),
+        registry_lock_(),
+        pins_lock_(),
+        value_(std::move(initial_value)),
+        make_(),
+        version_(0),
+        locals_(),
+        stats_() {
+    static_assert(std::is_copy_constructible<MutableT>::value,
+                  "T must be copyable, otherwise use the constructor with "
+                  "`make`");
+  }
+  // Constructs a RCU with an initial value constructed by `make`, which is
+  // kept for constructing values of `View` instances registered later, until
+  // the next `Update`. Required if `T` isn't copyable.
+  template <typename F, typename = EnableIfFactory<F>>
+  explicit CopyRcu(F make)
+      : CopyRcu(Factory(std::move(make)), ShardedFanOut{0, nullptr}, 0) {}
+  template <typename F, typename = EnableIfFactory<F>>
+  CopyRcu(F make, ShardedFanOut fan_out)
+      : CopyRcu(Factory(std::move(make)), std::move(fan_out), 0) {}
+  ~CopyRcu() noexcept {
+    delete pending_.load(std::memory_order_acquire);
+    ResolvePulls(std::is_copy_constructible<MutableT>());
+  }
 
   // Updates `value` in all registered `View` threads.
   // Returns the previous value. Note that the previous value can still be
@@ -188,8 +601,24 @@ class CopyRcu {
   // threads that have no `View` instance at all.
   T Update(typename std::remove_const<T>::type value)
       ABSL_LOCKS_EXCLUDED(lock_) {
-    absl::MutexLock mutex(&lock_);
-    return UpdateLocked(std::move(value));
+    lock_.Lock();
+    T previous = UpdateLocked(std::move(value));
+    UnlockAndDrain();
+    return previous;
+  }
+  // Similar to `Update`, but instead of copying a value into each `View`, it
+  // constructs a separate value for each of them (and one more to keep) by
+  // calling `make`. Suitable for types that are expensive or impossible to
+  // copy.
+  //
+  // `make` is kept for constructing values of `View` instances registered
+  // later, until the next update, and is called under an internal lock.
+  template <typename F, typename = EnableIfFactory<F>>
+  T Update(F make) ABSL_LOCKS_EXCLUDED(lock_) {
+    lock_.Lock();
+    T previous = UpdateLocked(Factory(std::move(make)));
+    UnlockAndDrain();
+    return previous;
   }
   // Similar to `Update`, but replaces the value only if the old one satisfies
   // the given predicate. Often the predicate will be an equality with a
@@ -197,12 +626,147 @@ class CopyRcu {
   absl::optional<T> UpdateIf(typename std::remove_const<T>::type value,
                              absl::FunctionRef<bool(const T &)> pred)
       ABSL_LOCKS_EXCLUDED(lock_) {
-    absl::MutexLock mutex(&lock_);
-    if (pred(value_)) {
-      return absl::make_optional(UpdateLocked(std::move(value)));
-    } else {
-      return absl::nullopt;
+    lock_.Lock();
+    absl::optional<T> previous;
+    if (pred(ValueLocked())) {
+      previous.emplace(UpdateLocked(std::move(value)));
+    }
+    UnlockAndDrain();
+    return previous;
+  }
+
+  // Combining, last-writer-wins variant of `Update`, which never waits for
+  // other writers.
+  //
+  // The value is deposited into an atomic slot, replacing (and destroying) any
+  // value deposited there by a concurrent call that hasn't been distributed
+  // yet. If no other thread is currently distributing a value to `View`
+  // instances, the calling thread becomes the one to do it, on behalf of
+  // itself and all writers that arrive in the meantime. Otherwise the call
+  // returns immediately and the value is distributed by that other thread.
+  //
+  // Therefore when concurrent calls return, it is guaranteed that the value of
+  // the last one of them is (or is being) distributed to all `View`s, but
+  // values of the others might have been skipped.
+  //
+  // Thread-safe.
+  void UpdateLatest(typename std::remove_const<T>::type value)
+      ABSL_LOCKS_EXCLUDED(lock_) {
+    std::unique_ptr<MutableT> superseded(pending_.exchange(
+        new MutableT(std::move(value)), std::memory_order_acq_rel));
+    DrainPending();
+  }
+
+  // Modifies the value by `mutator` in place, without copying it.
+  //
+  // Instead of assigning a copy of the new value to each `View`, `mutator` is
+  // applied to the instance recycled from it. This instance is usually just
+  // one or two updates behind, so it's first brought up to date by replaying
+  // the mutators of the last few `UpdateWith` calls. Only if it's older than
+  // that (or if it predates an `Update`), it's assigned a copy first.
+  //
+  // Therefore `mutator` must modify any two equal values the same way, and
+  // must be copyable, as it's kept for replaying. When distributing values
+  // in parallel (see `ShardedFanOut`), it must be safe to call concurrently on
+  // distinct values.
+  //
+  // This is useful for large values of `T`, such as containers, where each
+  // update changes only a small part.
+  //
+  // Thread-safe.
+  void UpdateWith(std::function<void(MutableT &)> mutator)
+      ABSL_LOCKS_EXCLUDED(lock_) {
+    lock_.Lock();
+    UpdateWithLocked(std::move(mutator));
+    UnlockAndDrain();
+  }
+
+  // Returns the version of the current value. It's 0 for the initial value and
+  // incremented by each update that modifies it, such as `Update` or
+  // `UpdateWith`. The version of a `Snapshot` never exceeds this.
+  //
+  // Thread-safe.
+  uint_fast64_t Version() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    absl::MutexLock registry(&registry_lock_);
+    return version_;
+  }
+
+  // Returns `true` if every registered `View` has advanced to a value of at
+  // least `version`, so that none of them can observe an older value any more.
+  //
+  // A `View` advances only by an outermost `Read()` (or `ReadPtr()`). So this
+  // returns `false` while any `View` holds a `Snapshot` from before `version`,
+  // and also while any `View` hasn't read since, even if it holds no
+  // `Snapshot`. Destroyed `View`s are no longer considered. Doesn't consider
+  // `Pinned` values, see `WaitForReaders`.
+  //
+  // Doesn't interrupt readers, but waits for an `Update` in progress and
+  // delays other updates while scanning all `View` instances.
+  //
+  // Thread-safe.
+  bool ReadersPassed(uint_fast64_t version)
+      ABSL_LOCKS_EXCLUDED(lock_, registry_lock_) {
+    lock_.Lock();
+    bool passed = true;
+    {
+      absl::MutexLock registry(&registry_lock_);
+      for (const auto &local : locals_) {
+        // Holding `lock_` makes this thread the Updater of all `locals_`.
+        if (!local->abandoned.load(std::memory_order_acquire) &&
+            local->local_rcu.PeekReadByUpdate().version < version) {
+          passed = false;
+          break;
+        }
+      }
+    }
+    UnlockAndDrain();
+    return passed;
+  }
+
+  // Waits until `ReadersPassed(version)` and then until all `Pinned` values
+  // that exist at that point are destroyed. Argument `version` should not
+  // exceed `Version()`, otherwise it waits for further updates.
+  //
+  // Polls, first just yielding the thread, then backing off exponentially up
+  // to `kMaxWaitBackoff`, so that `View`s that read rarely are waited for
+  // without repeatedly delaying updates.
+  //
+  // Thread-safe.
+  void WaitForReaders(uint_fast64_t version)
+      ABSL_LOCKS_EXCLUDED(lock_, registry_lock_, pins_lock_) {
+    Poll([this, version]() { return ReadersPassed(version); });
+    WaitForPins();
+  }
+
+  // Waits until every registered `View` has advanced to the current value (or
+  // a newer one), see `WaitForReaders`. Afterwards no `View` can observe any
+  // value replaced before the call. Returns the version waited for.
+  //
+  // Thread-safe.
+  uint_fast64_t Synchronize() ABSL_LOCKS_EXCLUDED(lock_, registry_lock_) {
+    const uint_fast64_t version = Version();
+    WaitForReaders(version);
+    return version;
+  }
+
+  // Returns statistics of this instance. Unless the stats policy is
+  // `WithStats`, only `views` is set and everything else is zero.
+  //
+  // Doesn't wait for updates in progress, nor does it interrupt readers.
+  // Counters recorded concurrently might not be included yet.
+  //
+  // Thread-safe.
+  RcuStats Stats() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    RcuStats stats{};
+    absl::MutexLock registry(&registry_lock_);
+    stats_.AddTo(stats);
+    for (const auto &local : locals_) {
+      if (!local->abandoned.load(std::memory_order_relaxed)) {
+        stats.views++;
+      }
+      local->AddTo(stats);
     }
+    return stats;
   }
 
   // Retrieves a thread-local instalce of `View` bound to `rcu`.
@@ -211,17 +775,19 @@ class CopyRcu {
   //
   // The returned reference is valid until a next call to `GetThreadLocal` or
   // `CleanUpThreadLocal` by the same thread.
-  static View &GetThreadLocal(std::shared_ptr<CopyRcu> rcu) noexcept {
-    auto pair =
-        ThreadLocal<std::unique_ptr<View>, CopyRcu>::Get(std::move(rcu));
-    if (pair.second) {  // Inserted.
-      pair.first.local() = absl::make_unique<View>(pair.first.shared());
-      int deleted_count = CleanUpThreadLocal();
-      ABSL_DLOG_IF(INFO, deleted_count > 0)
-          << "Cleaned up " << deleted_count
-          << " expired `View` instances from the thread-local map";
+  //
+  // Recently used instances are found in a small thread-local cache, without
+  // any hashing or reference counting.
+  static View &GetThreadLocal(const std::shared_ptr<CopyRcu> &rcu) noexcept {
+    CacheEntry &entry = ThreadLocalCache()[rcu->id_ % kThreadLocalCacheSize];
+    if (ABSL_PREDICT_TRUE(entry.id == rcu->id_)) {
+      // Since `id_` is never reused, `rcu` is alive and it holds the `View`
+      // in the thread-local map.
+      return *entry.view;
     }
-    return *pair.first.local();
+    View &view = GetThreadLocalSlow(rcu);
+    entry = CacheEntry{rcu->id_, &view};
+    return view;
   }
 
   // Cleans up `View` instances created by `GetThreadLocal`, whose `CopyRcu`
@@ -233,65 +799,572 @@ class CopyRcu {
   // new `View` instance to the map, so in most cases it's not necessary to
   // call it explicitly.
   static int CleanUpThreadLocal() noexcept {
-    return ThreadLocal<std::unique_ptr<View>, CopyRcu>::CleanUp();
+    return ThreadLocal<ThreadLocalView, CopyRcu>::CleanUp();
   }
 
  private:
-  T UpdateLocked(typename std::remove_const<T>::type value)
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
-    for (auto *local : locals_) {
-      Local3StateRcu<MutableT> &local_rcu = local->local_rcu;
-      local_rcu.Update() = value;
-      local_rcu.ForceUpdate();
+  using Local = typename View::Local;
+
+  static constexpr size_t kThreadLocalArenaSize = 8;
+
+  // Thread-local `View` instances are constructed in a small thread-local
+  // arena of `kThreadLocalArenaSize` slots, so that a thread's first
+  // `GetThreadLocal` calls don't allocate them on the heap. Only when all
+  // slots are taken are further instances allocated on the heap. Slots
+  // released by `CleanUpThreadLocal` are reused.
+  struct ThreadLocalArena {
+    typename std::aligned_storage<sizeof(View), alignof(View)>::type
+        slots[kThreadLocalArenaSize];
+    bool used[kThreadLocalArenaSize];
+  };
+
+  // Destroys a `View` constructed by `NewThreadLocalView` by the same thread.
+  struct ThreadLocalViewDeleter {
+    void operator()(View *view) const noexcept {
+      ThreadLocalArena &arena = Arena();
+      for (size_t i = 0; i < kThreadLocalArenaSize; i++) {
+        if (static_cast<void *>(view) == &arena.slots[i]) {
+          view->~View();
+          arena.used[i] = false;
+          return;
+        }
+      }
+      delete view;
+    }
+  };
+  using ThreadLocalView = std::unique_ptr<View, ThreadLocalViewDeleter>;
+
+  // Maps `id_ % kThreadLocalCacheSize` to a `View` in the map of
+  // `ThreadLocal`, as returned by `GetThreadLocalSlow`.
+  struct CacheEntry {
+    // The `id_` of the `CopyRcu` the `View` is bound to, or 0 if none.
+    uint_fast64_t id;
+    View *view;
+  };
+
+  static constexpr size_t kThreadLocalCacheSize = 8;
+
+  static uint_fast64_t NewId() {
+    static std::atomic<uint_fast64_t> last_id(0);
+    return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  static CacheEntry (&ThreadLocalCache())[kThreadLocalCacheSize] {
+    static thread_local CacheEntry cache[kThreadLocalCacheSize] = {};
+    return cache;
+  }
+
+  // Trivially destructible, so it remains usable while other `thread_local`
+  // objects, such as the map of `ThreadLocal`, are being destroyed.
+  static ThreadLocalArena &Arena() {
+    static thread_local ThreadLocalArena arena = {};
+    return arena;
+  }
+
+  static ThreadLocalView NewThreadLocalView(CopyRcu &rcu) {
+    ThreadLocalArena &arena = Arena();
+    for (size_t i = 0; i < kThreadLocalArenaSize; i++) {
+      if (!arena.used[i]) {
+        ThreadLocalView view(new (&arena.slots[i]) View(rcu));
+        arena.used[i] = true;
+        return view;
+      }
+    }
+    return ThreadLocalView(new View(rcu));
+  }
+
+  static View &GetThreadLocalSlow(std::shared_ptr<CopyRcu> rcu) noexcept {
+    auto pair = ThreadLocal<ThreadLocalView, CopyRcu>::Get(std::move(rcu));
+    if (pair.second) {  // Inserted.
+      pair.first.local() = NewThreadLocalView(*pair.first.shared());
+      int deleted_count = CleanUpThreadLocal();
+      ABSL_DLOG_IF(INFO, deleted_count > 0)
+          << "Cleaned up " << deleted_count
+          << " expired `View` instances from the thread-local map";
     }
-    std::swap(value_, value);
+    return *pair.first.local();
+  }
+
+  // The last argument only distinguishes this constructor from the public
+  // ones.
+  CopyRcu(Factory make, ShardedFanOut fan_out, int)
+      : id_(NewId()),
+        sharded_fan_out_(std::move(fan_out)),
+        lock_(),
+        fan_out_(),
+        pending_(nullptr),
+        history_(),
+        registry_lock_(),
+        pins_lock_(),
+        value_(make()),
+        make_(std::move(make)),
+        version_(0),
+        locals_(),
+        stats_() {}
+
+  // The maximum number of `UpdateWith` mutators kept for replaying.
+  static constexpr size_t kMaxHistory = 4;
+  // Polling parameters of `WaitForReaders`.
+  static constexpr int kWaitYields = 16;
+  static constexpr std::chrono::microseconds kMaxWaitBackoff{1000};
+
+  // Calls `done` until it returns `true`, see `WaitForReaders`.
+  static void Poll(absl::FunctionRef<bool()> done) {
+    std::chrono::microseconds backoff(1);
+    for (int attempt = 0; !done(); attempt++) {
+      if (attempt < kWaitYields) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, kMaxWaitBackoff);
+      }
+    }
+  }
+
+  // Waits until all `Pinned` instances that existed when every `View` had
+  // already advanced to the version waited for are destroyed.
+  //
+  // For each `Local` it flips `pin_phase` and waits for the pins counted in
+  // the previous phase. Since `View::Pin()` counts a pin before reading its
+  // value, a pin missed by the wait has read its value after all `View`s
+  // advanced, so it's at least the version waited for. Waiters are
+  // serialized, so that pins counted in the current phase are never waited
+  // for and continuous pinning can't starve them.
+  void WaitForPins() ABSL_LOCKS_EXCLUDED(registry_lock_, pins_lock_) {
+    absl::MutexLock pins(&pins_lock_);
+    std::vector<std::shared_ptr<Local>> locals;
+    {
+      absl::MutexLock registry(&registry_lock_);
+      locals = locals_;
+    }
+    for (const auto &local : locals) {
+      const uint_fast8_t phase =
+          local->pin_phase.fetch_xor(1, std::memory_order_seq_cst);
+      Poll([&local, phase]() {
+        return local->pins[phase].load(std::memory_order_seq_cst) == 0;
+      });
+    }
+  }
+
+  // Return `value_` and `version_` to a thread holding just `lock_`, see
+  // `value_`.
+  const MutableT &ValueLocked() const ABSL_SHARED_LOCKS_REQUIRED(lock_)
+      ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    return value_;
+  }
+  uint_fast64_t VersionLocked() const ABSL_SHARED_LOCKS_REQUIRED(lock_)
+      ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    return version_;
+  }
+
+  // Distributes `value` to all registered `View` instances.
+  T UpdateLocked(typename std::remove_const<T>::type value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    const uint_fast64_t version = VersionLocked() + 1;
+    FanOut(
+        [&value, version](Local &local) {
+          return Push(local, value, version);
+        },
+        [this, &value, version]()
+            ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_, registry_lock_) {
+              std::swap(value_, value);
+              make_ = nullptr;
+              version_ = version;
+            });
+    // Values older than `value` can't be brought up to date by replaying.
+    history_.clear();
+    return value;
+  }
+
+  // Distributes values constructed by `make` to all registered `View`
+  // instances.
+  T UpdateLocked(Factory make) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_)
+      ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    const uint_fast64_t version = VersionLocked() + 1;
+    MutableT value = make();
+    FanOut(
+        [&make, version](Local &local) {
+          typename Local::Versioned &update = local.local_rcu.Update();
+          update.value = make();
+          update.version = version;
+          return local.ForceUpdate();
+        },
+        [this, &make, &value, version]()
+            ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_, registry_lock_) {
+              std::swap(value_, value);
+              make_ = std::move(make);
+              version_ = version;
+            });
+    history_.clear();
     return value;
   }
 
-  // Returns the current value.
-  T RegisterLocked(typename View::Local &local) ABSL_MUST_USE_RESULT
+  // Applies `mutator` to all registered `View` instances, see `UpdateWith`.
+  void UpdateWithLocked(std::function<void(MutableT &)> mutator)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    FanOut(
+        [this, &mutator](Local &local) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+          return Patch(local, mutator);
+        },
+        [this, &mutator]()
+            ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_, registry_lock_) {
+              mutator(value_);
+              make_ = nullptr;
+              version_++;
+            });
+    history_.push_back(std::move(mutator));
+    if (history_.size() > kMaxHistory) {
+      history_.pop_front();
+    }
+  }
+
+  // Calls `push` for all registered `View` instances and then `commit` while
+  // holding `registry_lock_`, which should update `value_` accordingly.
+  // `push` returns the result of `ForceUpdate`, that is, `false` if the
+  // `View` hasn't read the value pushed previously.
+  //
+  // `registry_lock_` is held only while taking a snapshot of `locals_` and
+  // while finishing instances registered after the snapshot (usually none),
+  // so registration of new `View`s doesn't wait for `push`ing to all the
+  // existing ones.
+  void FanOut(absl::FunctionRef<bool(Local &)> push,
+              absl::FunctionRef<void()> commit)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    stats_.Start();
+    // Instances abandoned by their `View`s. Destroyed only after releasing
+    // `registry_lock_`.
+    std::vector<std::shared_ptr<Local>> abandoned;
+    {
+      absl::MutexLock registry(&registry_lock_);
+      for (size_t i = 0; i < locals_.size();) {
+        // Only `locals_` holds the instance and no new owner can appear.
+        if (locals_[i].use_count() == 1) {
+          stats_.Retire(*locals_[i]);
+          abandoned.push_back(std::move(locals_[i]));
+          locals_[i] = std::move(locals_.back());
+          locals_.pop_back();
+        } else {
+          i++;
+        }
+      }
+      fan_out_.clear();
+      for (const auto &local : locals_) {
+        // Kept only by `Pinned` values, which don't need further updates.
+        if (!local->abandoned.load(std::memory_order_acquire)) {
+          fan_out_.push_back(local.get());
+        }
+      }
+    }
+    // Instances are removed from `locals_` only above, therefore all pointers
+    // in `fan_out_` remain valid.
+    const size_t shard_size = sharded_fan_out_.shard_size;
+    // The number of `push` calls that returned `false`.
+    std::atomic<size_t> unread(0);
+    if (sharded_fan_out_.executor && (fan_out_.size() > shard_size)) {
+      // Each `Local` belongs to exactly one shard, so it still has a single
+      // Updater.
+      sharded_fan_out_.executor(
+          (fan_out_.size() + shard_size - 1) / shard_size,
+          [this, shard_size, push, &unread](size_t shard) {
+            const size_t end =
+                std::min((shard + 1) * shard_size, fan_out_.size());
+            size_t shard_unread = 0;
+            for (size_t i = shard * shard_size; i < end; i++) {
+              shard_unread += !TracePush(push, *fan_out_[i]);
+            }
+            unread.fetch_add(shard_unread, std::memory_order_relaxed);
+          });
+    } else {
+      size_t serial_unread = 0;
+      for (Local *local : fan_out_) {
+        serial_unread += !TracePush(push, *local);
+      }
+      unread.store(serial_unread, std::memory_order_relaxed);
+    }
+    absl::MutexLock registry(&registry_lock_);
+    // Instances registered since the snapshot have been appended at its end
+    // and have received the previous value.
+    size_t late_unread = 0;
+    for (size_t i = fan_out_.size(); i < locals_.size(); i++) {
+      late_unread += !TracePush(push, *locals_[i]);
+    }
+    commit();
+    stats_.Finish(locals_.size(),
+                  unread.load(std::memory_order_relaxed) + late_unread);
+  }
+
+  // Calls `push` for `local` between trace events, see `SIMPLE_RCU_TRACE`.
+  static bool TracePush(const absl::FunctionRef<bool(Local &)> &push,
+                        Local &local) {
+    SIMPLE_RCU_TRACE(PushBegin, &local, 0);
+    const bool read = push(local);
+    SIMPLE_RCU_TRACE(PushEnd, &local, read);
+    return read;
+  }
+
+  static bool Push(Local &local, const MutableT &value, uint_fast64_t version) {
+    if (DeferPush(local, version)) {
+      return false;
+    }
+    typename Local::Versioned &update = local.local_rcu.Update();
+    update.value = value;
+    update.version = version;
+    return local.ForceUpdate();
+  }
+
+  // Brings the instance recycled from `local` up to date and applies
+  // `mutator` to it.
+  bool Patch(Local &local, const std::function<void(MutableT &)> &mutator)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
-    locals_.insert(&local);
-    return value_;
+    typename Local::Versioned &update = local.local_rcu.Update();
+    // Even with `ShardedFanOut` these are only read concurrently.
+    const uint_fast64_t version = VersionLocked();
+    if (update.version + history_.size() < version) {
+      update.value = ValueLocked();
+      update.version = version;
+    }
+    for (auto it = history_.end() - (version - update.version);
+         it != history_.end(); ++it) {
+      (*it)(update.value);
+    }
+    mutator(update.value);
+    update.version = version + 1;
+    return local.ForceUpdate();
   }
 
-  void Unregister(typename View::Local &local) ABSL_LOCKS_EXCLUDED(lock_) {
-    absl::MutexLock mutex(&lock_);
-    locals_.erase(&local);
+  // Called by the Updater of `local` instead of pushing the value of update
+  // `version`, if its `View` hasn't read the previous one yet: Requests the
+  // `View` to pull the current value on its next read and returns `true`.
+  // Returns `false` if the value still needs to be pushed.
+  static bool DeferPush(Local &local, uint_fast64_t version) noexcept {
+    if (!local.local_rcu.PendingRead()) {
+      return false;
+    }
+    uint_fast64_t requested =
+        local.pull_version.load(std::memory_order_relaxed);
+    do {
+      if (requested == Local::kPulling) {
+        return false;
+      }
+    } while (!local.pull_version.compare_exchange_weak(
+        requested, version, std::memory_order_relaxed));
+    // If the `View` has advanced meanwhile, it may be already waiting for
+    // the value, see `Local::PullRequested`. The request is then kept, which
+    // costs the `View` just a redundant pull.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return local.local_rcu.PendingRead();
   }
 
-  absl::Mutex lock_;
+  // Called by the `View` of `local` (as its Reader) after claiming the pull
+  // requested by update `requested`, see `Local::ClaimPull`. Advances to the
+  // current value, unless that update hasn't committed it yet, in which case
+  // the request is kept for the next read. Returns whether it advanced to a
+  // new value.
+  bool Pull(Local &local, uint_fast64_t requested) noexcept
+      ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    return PullLocked(local, requested, std::is_copy_constructible<MutableT>());
+  }
+  // Pulls are requested only by `Push`, which requires a copyable `T`.
+  //
+  // Copies `value_` while holding `registry_lock_` rather than `lock_`, so
+  // that a `Read()` that pulls waits at most for a single copy of `T`, not
+  // for a whole update in progress.
+  bool PullLocked(Local &local, uint_fast64_t requested, std::true_type)
+      ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    bool advanced;
+    uint_fast64_t unresolved;
+    {
+      absl::MutexLock registry(&registry_lock_);
+      // Take any value pushed meanwhile, so that a value older than the
+      // pulled one can't be left in flight.
+      advanced = local.local_rcu.TryRead();
+      // The Updater only reads this instance while holding `registry_lock_`,
+      // see `ReadersPassed`.
+      typename Local::Versioned &read = local.local_rcu.Read();
+      if (read.version < version_) {
+        read.value = value_;
+        read.version = version_;
+        advanced = true;
+      }
+      unresolved = version_ >= requested ? Local::kNoPull : requested;
+    }
+    // Releases the claim only after `registry_lock_`, since afterwards
+    // `~CopyRcu` may destroy this instance.
+    local.pull_version.store(unresolved, std::memory_order_release);
+    return advanced;
+  }
+  bool PullLocked(Local &local, uint_fast64_t, std::false_type) {
+    local.pull_version.store(Local::kNoPull, std::memory_order_release);
+    return false;
+  }
+
+  // Pushes the current value to `View`s with a pending pull, since they may
+  // outlive this instance. Waits for pulls in progress.
+  void ResolvePulls(std::true_type) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    // No update or registration can run concurrently with destruction.
+    for (const auto &local : locals_) {
+      uint_fast64_t requested =
+          local->pull_version.load(std::memory_order_acquire);
+      while (requested != Local::kNoPull) {
+        if (requested == Local::kPulling) {
+          std::this_thread::yield();
+          requested = local->pull_version.load(std::memory_order_acquire);
+        } else if (local->pull_version.compare_exchange_weak(
+                       requested, Local::kNoPull, std::memory_order_acquire)) {
+          typename Local::Versioned &update = local->local_rcu.Update();
+          update.value = value_;
+          update.version = version_;
+          local->ForceUpdate();
+          break;
+        }
+      }
+    }
+  }
+  void ResolvePulls(std::false_type) {}
+
+  // Releases `lock_` and distributes values deposited by `UpdateLatest`
+  // callers that found `lock_` held in the meantime.
+  void UnlockAndDrain() ABSL_UNLOCK_FUNCTION(lock_) {
+    lock_.Unlock();
+    // Values are deposited by `UpdateLatest` only if `T` is copyable.
+    DrainPending(std::is_copy_constructible<MutableT>());
+  }
+
+  // Distributes the value in `pending_` (if any), unless another thread holds
+  // `lock_`, in which case that thread takes over the responsibility.
+  void DrainPending(std::true_type = {}) ABSL_LOCKS_EXCLUDED(lock_) {
+    // Pairs a writer that publishes into `pending_` and then fails `TryLock`
+    // with the lock holder that releases `lock_` and then reads `pending_`:
+    // The sequentially consistent fences ensure at least one of them observes
+    // the other's write, so a deposited value is never left behind.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (pending_.load(std::memory_order_relaxed) != nullptr &&
+           lock_.TryLock()) {
+      std::unique_ptr<MutableT> value(
+          pending_.exchange(nullptr, std::memory_order_acq_rel));
+      if (value != nullptr) {
+        UpdateLocked(std::move(*value));
+      }
+      lock_.Unlock();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+  void DrainPending(std::false_type) {}
+
+  // Returns a new `Local` instance holding the current value, registered in
+  // `locals_`.
+  std::shared_ptr<Local> Register() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    absl::MutexLock registry(&registry_lock_);
+    locals_.push_back(NewLocal(std::is_copy_constructible<MutableT>()));
+    return locals_.back();
+  }
+
+  // Copies `value_`, which is always up to date.
+  std::shared_ptr<Local> NewLocal(std::true_type)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(registry_lock_) {
+    return std::make_shared<Local>(*this, value_, version_);
+  }
+  // Only `Update(Factory)` is available for a non-copyable `T`, therefore
+  // `make_` always constructs a value equal to `value_`.
+  std::shared_ptr<Local> NewLocal(std::false_type)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(registry_lock_) {
+    return std::make_shared<Local>(*this, make_, version_);
+  }
+
+  // Unique among all `CopyRcu<T>` instances ever constructed, so that it
+  // identifies this instance even after another one reuses its memory.
+  const uint_fast64_t id_;
+  const ShardedFanOut sharded_fan_out_;
+  // Serializes distributing values to `View` instances.
+  typename CopyRcuUpdateMutexOf<Policy>::type lock_;
+  // Pointers to `locals_` being updated by `UpdateLocked`. Kept here to avoid
+  // allocating a new vector on each call.
+  std::vector<Local *> fan_out_ ABSL_GUARDED_BY(lock_);
+  // Value deposited by `UpdateLatest` that hasn't been distributed yet.
+  std::atomic<MutableT *> pending_;
+  // Mutators of the last (at most `kMaxHistory`) `UpdateWith` calls since the
+  // last `Update`, the last one producing `version_`.
+  std::deque<std::function<void(MutableT &)>> history_ ABSL_GUARDED_BY(lock_);
+  // Protects `locals_` and `value_` when registering a new `View`, so that
+  // `View`s don't need to wait for `lock_`. Held only for a short time, except
+  // by a `View` pulling a deferred value, which copies `value_` while holding
+  // it (see `PullLocked`). So with a large `T`, registration, `Stats()` and
+  // committing an update can wait for a single copy of `T`.
+  // When both are acquired, `lock_` is always acquired first.
+  absl::Mutex registry_lock_ ABSL_ACQUIRED_AFTER(lock_);
+  // Serializes `WaitForPins`.
+  absl::Mutex pins_lock_ ABSL_ACQUIRED_BEFORE(registry_lock_);
   // The current value that has been distributed to all thread-`View`
   // instances.
-  MutableT value_ ABSL_GUARDED_BY(lock_);
-  // List of registered thread-`View` instances.
-  absl::flat_hash_set<typename View::Local *> locals_ ABSL_GUARDED_BY(lock_);
+  //
+  // `value_`, `make_` and `version_` are modified only while holding both
+  // `lock_` and `registry_lock_`, so holding either is sufficient for reading
+  // them. Since thread-safety analysis can't express that, they're annotated
+  // with `registry_lock_` and read while holding just `lock_` only through
+  // `ValueLocked()` and `VersionLocked()`.
+  MutableT value_ ABSL_GUARDED_BY(registry_lock_);
+  // The factory passed to the last update, if it was `Update(Factory)`.
+  Factory make_ ABSL_GUARDED_BY(registry_lock_);
+  // Incremented with each modification of `value_`.
+  uint_fast64_t version_ ABSL_GUARDED_BY(registry_lock_);
+  // Registered thread-`View` instances.
+  std::vector<std::shared_ptr<Local>> locals_ ABSL_GUARDED_BY(registry_lock_);
+  // Modified only when holding `lock_`, retiring `locals_` also when holding
+  // `registry_lock_`.
+  typename Policy::Updater stats_;
+
+  friend class CopyRcuGroup;
 };
 
+template <typename T, typename Policy>
+constexpr uint_fast64_t CopyRcu<T, Policy>::View::Local::kNoPull;
+template <typename T, typename Policy>
+constexpr uint_fast64_t CopyRcu<T, Policy>::View::Local::kPulling;
+template <typename T, typename Policy>
+constexpr size_t CopyRcu<T, Policy>::kMaxHistory;
+template <typename T, typename Policy>
+constexpr size_t CopyRcu<T, Policy>::kThreadLocalCacheSize;
+template <typename T, typename Policy>
+constexpr size_t CopyRcu<T, Policy>::kThreadLocalArenaSize;
+template <typename T, typename Policy>
+constexpr int CopyRcu<T, Policy>::kWaitYields;
+template <typename T, typename Policy>
+constexpr std::chrono::microseconds CopyRcu<T, Policy>::kMaxWaitBackoff;
+
 // A variant of `CopyRcu<T>::View::Read()` that automatically maintains a
 // `thread_local` instance of `CopyRcu<T>::View` bound to `rcu`.
 //
 // This makes this function easier to use compared to an explicit management of
-// `View`, at the cost of some inherentt performance overhead of
-// `thread_local`.
-template <typename T>
-inline typename CopyRcu<T>::Snapshot Read(
-    std::shared_ptr<CopyRcu<T>> rcu) noexcept {
-  return CopyRcu<T>::GetThreadLocal(std::move(rcu)).Read();
+// `View`, at the cost of a small overhead for looking up the `thread_local`
+// instance.
+template <typename T, typename Policy>
+inline typename CopyRcu<T, Policy>::Snapshot Read(
+    const std::shared_ptr<CopyRcu<T, Policy>> &rcu) noexcept {
+  return CopyRcu<T, Policy>::GetThreadLocal(rcu).Read();
 }
 
 // A variant of `CopyRcu<T>::View::ReadPtr()` that automatically maintains a
 // `thread_local` instance of `CopyRcu<T>::View` bound to `rcu`.
 //
 // This makes this function easier to use compared to an explicit management of
-// `View`, at the cost of some inherentt performance overhead of
-// `thread_local`.
-template <typename T>
-inline std::unique_ptr<
-    typename T::element_type,
-    typename CopyRcu<T>::template SnapshotDeleter<typename T::element_type>>
-ReadPtr(std::shared_ptr<CopyRcu<T>> rcu) noexcept {
-  return CopyRcu<T>::GetThreadLocal(std::move(rcu)).template ReadPtr<T>();
+// `View`, at the cost of a small overhead for looking up the `thread_local`
+// instance.
+template <typename T, typename Policy>
+inline typename CopyRcu<T, Policy>::template SnapshotPtr<
+    typename T::element_type>
+ReadPtr(const std::shared_ptr<CopyRcu<T, Policy>> &rcu) noexcept {
+  return CopyRcu<T, Policy>::GetThreadLocal(rcu).template ReadPtr<T>();
+}
+
+// A variant of `CopyRcu<T>::View::Pin()` that automatically maintains a
+// `thread_local` instance of `CopyRcu<T>::View` bound to `rcu`.
+//
+// This is the typical way to obtain values held across suspension points by
+// tasks of an executor, which thus share a `View` per executor thread.
+template <typename T, typename Policy>
+inline typename CopyRcu<T, Policy>::Pinned Pin(
+    const std::shared_ptr<CopyRcu<T, Policy>> &rcu) {
+  return CopyRcu<T, Policy>::GetThreadLocal(rcu).Pin();
 }
 
 // By using `CopyRcu<shared_ptr<const T>>` we accomplish a RCU implementation
@@ -303,8 +1376,9 @@ ReadPtr(std::shared_ptr<CopyRcu<T>> rcu) noexcept {
 //
 // Note that no memory (de)allocation happens in the reader threads that invoke
 // `ReadPtr` (or `Read`). This is done exclusively by the updater thread.
-template <typename T>
-using Rcu = CopyRcu<std::shared_ptr<typename std::add_const<T>::type>>;
+template <typename T, typename Policy = NoStats>
+using Rcu = CopyRcu<std::shared_ptr<typename std::add_const<T>::type>,
+                    Policy>;
 
 }  // namespace simple_rcu
 
@@ -0,0 +1,127 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks tracking heap allocations made by reader threads, reported as
+// the `allocs_per_read` counter. Kept separate from `copy_rcu_benchmark`, since
+// counting allocations replaces the global `operator new`, see
+// `alloc_counter.h`.
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/alloc_counter.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// Runs `update` repeatedly in a separate thread for the lifetime of this
+// object.
+class BackgroundUpdater {
+ public:
+  template <typename F>
+  explicit BackgroundUpdater(F update)
+      : finished_(false), thread_([this, update]() {
+          while (!finished_.load()) {
+            update();
+          }
+        }) {}
+  ~BackgroundUpdater() {
+    finished_.store(true);
+    thread_.join();
+  }
+
+ private:
+  std::atomic<bool> finished_;
+  std::thread thread_;
+};
+
+void SetAllocsPerRead(benchmark::State &state, uint64_t allocations) {
+  state.counters["allocs_per_read"] =
+      benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+void BM_ReadAllocations(benchmark::State &state) {
+  CopyRcu<int_fast32_t> rcu(0);
+  int_fast32_t updates = 0;
+  BackgroundUpdater updater([&]() { rcu.Update(updates++); });
+  CopyRcu<int_fast32_t>::View local(rcu);
+  const uint64_t allocations = ThreadAllocations();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(*local.Read());
+    benchmark::ClobberMemory();
+  }
+  SetAllocsPerRead(state, ThreadAllocations() - allocations);
+}
+BENCHMARK(BM_ReadAllocations);
+
+void BM_ReadPtrAllocations(benchmark::State &state) {
+  Rcu<int_fast32_t> rcu(std::make_shared<const int_fast32_t>(0));
+  int_fast32_t updates = 0;
+  BackgroundUpdater updater([&]() {
+    rcu.Update(std::make_shared<const int_fast32_t>(updates++));
+  });
+  Rcu<int_fast32_t>::View local(rcu);
+  const uint64_t allocations = ThreadAllocations();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(*local.ReadPtr());
+    benchmark::ClobberMemory();
+  }
+  SetAllocsPerRead(state, ThreadAllocations() - allocations);
+}
+BENCHMARK(BM_ReadPtrAllocations);
+
+void BM_ReadPtrThreadLocalAllocations(benchmark::State &state) {
+  auto rcu = std::make_shared<Rcu<int_fast32_t>>(
+      std::make_shared<const int_fast32_t>(0));
+  int_fast32_t updates = 0;
+  BackgroundUpdater updater([&]() {
+    rcu->Update(std::make_shared<const int_fast32_t>(updates++));
+  });
+  benchmark::DoNotOptimize(*ReadPtr(rcu));  // Registers a thread-local `View`.
+  const uint64_t allocations = ThreadAllocations();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(*ReadPtr(rcu));
+    benchmark::ClobberMemory();
+  }
+  SetAllocsPerRead(state, ThreadAllocations() - allocations);
+}
+BENCHMARK(BM_ReadPtrThreadLocalAllocations);
+
+// The first `ReadPtr` of a thread from a new RCU, which registers a
+// thread-local `View`. The `View` itself comes from a thread-local arena, but
+// registration still allocates the state shared with the updater.
+void BM_FirstReadPtrThreadLocalAllocations(benchmark::State &state) {
+  uint64_t allocations = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto rcu = std::make_shared<Rcu<int_fast32_t>>(
+        std::make_shared<const int_fast32_t>(0));
+    state.ResumeTiming();
+    const uint64_t before = ThreadAllocations();
+    benchmark::DoNotOptimize(*ReadPtr(rcu));
+    allocations += ThreadAllocations() - before;
+    state.PauseTiming();
+    rcu.reset();
+    state.ResumeTiming();
+  }
+  SetAllocsPerRead(state, allocations);
+}
+BENCHMARK(BM_FirstReadPtrThreadLocalAllocations);
+
+}  // namespace
+}  // namespace simple_rcu
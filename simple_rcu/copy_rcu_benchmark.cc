@@ -13,22 +13,28 @@
 // limitations under the License.
 
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <thread>
 
 #include "absl/log/absl_check.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "absl/types/optional.h"
 #include "benchmark/benchmark.h"
 #include "simple_rcu/copy_rcu.h"
+#include "simple_rcu/epoch_rcu.h"
+#include "simple_rcu/fan_out_pool.h"
+#include "simple_rcu/lazy_copy_rcu.h"
 
 namespace simple_rcu {
 namespace {
 
-template <typename T>
+// Shared state of a benchmark of a RCU of type `R`, such as `CopyRcu<T>`.
+template <typename R>
 struct Context {
-  Context(T initial_value)
-      : rcu(std::make_shared<CopyRcu<T>>(std::move(initial_value))),
-        finished(false) {}
+  explicit Context(std::shared_ptr<R> rcu_)
+      : rcu(std::move(rcu_)), finished(false) {}
   ~Context() {
     finished.store(true);
     for (auto& thread : threads) {
@@ -36,33 +42,35 @@ struct Context {
     }
   }
 
-  std::shared_ptr<CopyRcu<T>> rcu;
+  std::shared_ptr<R> rcu;
   std::atomic<bool> finished;
   std::deque<std::thread> threads;
 };
 
-template <typename T>
-static absl::optional<Context<T>>& StaticContext() {
-  static absl::optional<Context<T>> rcu;
+template <typename R>
+static absl::optional<Context<R>>& StaticContext() {
+  static absl::optional<Context<R>> rcu;
   return rcu;
 }
 
-template <typename T>
-static void Setup(T initial_value) {
-  auto& context = StaticContext<T>();
+// Sets up a context with a RCU constructed from `args`.
+template <typename R, typename... Args>
+static void Setup(Args... args) {
+  auto& context = StaticContext<R>();
   ABSL_CHECK(!context.has_value()) << "Context not teared down";
-  context.emplace(std::move(initial_value));
+  context.emplace(std::make_shared<R>(std::move(args)...));
 }
 
-template <typename T>
+template <typename R>
 static void Teardown(const benchmark::State& state) {
-  auto& context = StaticContext<T>();
+  auto& context = StaticContext<R>();
   ABSL_CHECK(context.has_value()) << "Mismatched Teardown";
   context.reset();
 }
 
+template <typename R>
 static void BM_Reads(benchmark::State& state) {
-  static auto& context = StaticContext<int_fast32_t>();
+  static auto& context = StaticContext<R>();
   if (state.thread_index() == 0) {
     for (int i = 0; i < state.range(0); i++) {
       context->threads.emplace_back([&]() {
@@ -73,21 +81,58 @@ static void BM_Reads(benchmark::State& state) {
       });
     }
   }
-  CopyRcu<int_fast32_t>::View reader(context->rcu);
+  typename R::View reader(*context->rcu);
   for (auto _ : state) {
     benchmark::DoNotOptimize(*reader.Read());
     benchmark::ClobberMemory();
   }
 }
-BENCHMARK(BM_Reads)
+BENCHMARK_TEMPLATE(BM_Reads, CopyRcu<int_fast32_t>)
+    ->Name("BM_Reads")
     ->ThreadRange(1, 64)
     ->Arg(1)
     ->Arg(4)
-    ->Setup([](const benchmark::State&) { Setup<int_fast32_t>(0); })
-    ->Teardown(Teardown<int_fast32_t>);
+    ->Setup([](const benchmark::State&) {
+      Setup<CopyRcu<int_fast32_t>>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<CopyRcu<int_fast32_t>>);
+// Each of these changes a single policy relative to the default `CopyRcu`.
+// With updates from other threads, padding keeps readers' lines from bouncing.
+using PaddedCopyRcu =
+    CopyRcu<int_fast32_t, CopyRcuPolicy<NoStats, CacheLinePaddedLayout>>;
+// Readers don't touch the update lock, so it should matter only for updates.
+using SpinLockCopyRcu =
+    CopyRcu<int_fast32_t, CopyRcuPolicy<NoStats, CompactLayout, SpinLock>>;
+BENCHMARK_TEMPLATE(BM_Reads, PaddedCopyRcu)
+    ->Name("BM_PaddedReads")
+    ->ThreadRange(1, 64)
+    ->Arg(1)
+    ->Arg(4)
+    ->Setup([](const benchmark::State&) {
+      Setup<PaddedCopyRcu>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<PaddedCopyRcu>);
+BENCHMARK_TEMPLATE(BM_Reads, SpinLockCopyRcu)
+    ->Name("BM_SpinLockReads")
+    ->ThreadRange(1, 64)
+    ->Arg(1)
+    ->Arg(4)
+    ->Setup([](const benchmark::State&) {
+      Setup<SpinLockCopyRcu>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<SpinLockCopyRcu>);
+BENCHMARK_TEMPLATE(BM_Reads, LazyCopyRcu<int_fast32_t>)
+    ->Name("BM_LazyReads")
+    ->ThreadRange(1, 64)
+    ->Arg(1)
+    ->Arg(4)
+    ->Setup([](const benchmark::State&) {
+      Setup<LazyCopyRcu<int_fast32_t>>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<LazyCopyRcu<int_fast32_t>>);
 
 static void BM_ReadSharedPtrs(benchmark::State& state) {
-  static auto& context = StaticContext<std::shared_ptr<const int_fast32_t>>();
+  static auto& context = StaticContext<Rcu<int_fast32_t>>();
   if (state.thread_index() == 0) {
     for (int i = 0; i < state.range(0); i++) {
       context->threads.emplace_back([&]() {
@@ -110,12 +155,41 @@ BENCHMARK(BM_ReadSharedPtrs)
     ->Arg(1)
     ->Arg(4)
     ->Setup([](const benchmark::State&) {
-      Setup(std::make_shared<const int_fast32_t>(0));
+      Setup<Rcu<int_fast32_t>>(std::make_shared<const int_fast32_t>(0));
     })
-    ->Teardown(Teardown<std::shared_ptr<const int_fast32_t>>);
+    ->Teardown(Teardown<Rcu<int_fast32_t>>);
+
+// Counterpart of `BM_ReadSharedPtrs` for `EpochRcu`.
+static void BM_EpochReadPtrs(benchmark::State& state) {
+  static auto& context = StaticContext<EpochRcu<int_fast32_t>>();
+  if (state.thread_index() == 0) {
+    for (int i = 0; i < state.range(0); i++) {
+      context->threads.emplace_back([&]() {
+        int_fast32_t updates = 0;
+        while (!context->finished.load()) {
+          context->rcu->Update(
+              absl::make_unique<const int_fast32_t>(updates++));
+        }
+      });
+    }
+  }
+  EpochRcu<int_fast32_t>::View local(context->rcu);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(*local.ReadPtr());
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_EpochReadPtrs)
+    ->ThreadRange(1, 64)
+    ->Arg(1)
+    ->Arg(4)
+    ->Setup([](const benchmark::State&) {
+      Setup<EpochRcu<int_fast32_t>>(absl::make_unique<const int_fast32_t>(0));
+    })
+    ->Teardown(Teardown<EpochRcu<int_fast32_t>>);
 
 static void BM_ReadSharedPtrsThreadLocal(benchmark::State& state) {
-  static auto& context = StaticContext<std::shared_ptr<const int_fast32_t>>();
+  static auto& context = StaticContext<Rcu<int_fast32_t>>();
   if (state.thread_index() == 0) {
     for (int i = 0; i < state.range(0); i++) {
       context->threads.emplace_back([&]() {
@@ -137,16 +211,17 @@ BENCHMARK(BM_ReadSharedPtrsThreadLocal)
     ->Arg(1)
     ->Arg(4)
     ->Setup([](const benchmark::State&) {
-      Setup(std::make_shared<const int_fast32_t>(0));
+      Setup<Rcu<int_fast32_t>>(std::make_shared<const int_fast32_t>(0));
     })
-    ->Teardown(Teardown<std::shared_ptr<const int_fast32_t>>);
+    ->Teardown(Teardown<Rcu<int_fast32_t>>);
 
+template <typename R>
 static void BM_Updates(benchmark::State& state) {
-  static auto& context = StaticContext<int_fast32_t>();
+  static auto& context = StaticContext<R>();
   if (state.thread_index() == 0) {
     for (int i = 0; i < state.range(0); i++) {
       context->threads.emplace_back([&]() {
-        CopyRcu<int_fast32_t>::View local(context->rcu);
+        typename R::View local(*context->rcu);
         while (!context->finished.load()) {
           benchmark::DoNotOptimize(*local.Read());
         }
@@ -159,12 +234,94 @@ static void BM_Updates(benchmark::State& state) {
     benchmark::ClobberMemory();
   }
 }
-BENCHMARK(BM_Updates)
+BENCHMARK_TEMPLATE(BM_Updates, CopyRcu<int_fast32_t>)
+    ->Name("BM_Updates")
     ->ThreadRange(1, 64)
     ->Arg(1)
     ->Arg(4)
-    ->Setup([](const benchmark::State&) { Setup<int_fast32_t>(0); })
-    ->Teardown(Teardown<int_fast32_t>);
+    ->Setup([](const benchmark::State&) {
+      Setup<CopyRcu<int_fast32_t>>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<CopyRcu<int_fast32_t>>);
+BENCHMARK_TEMPLATE(BM_Updates, PaddedCopyRcu)
+    ->Name("BM_PaddedUpdates")
+    ->ThreadRange(1, 64)
+    ->Arg(1)
+    ->Arg(4)
+    ->Setup([](const benchmark::State&) {
+      Setup<PaddedCopyRcu>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<PaddedCopyRcu>);
+BENCHMARK_TEMPLATE(BM_Updates, SpinLockCopyRcu)
+    ->Name("BM_SpinLockUpdates")
+    ->ThreadRange(1, 64)
+    ->Arg(1)
+    ->Arg(4)
+    ->Setup([](const benchmark::State&) {
+      Setup<SpinLockCopyRcu>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<SpinLockCopyRcu>);
+
+// Measures updates with a large number of registered, mostly idle `View`
+// instances, which is dominated by distributing the value to all of them.
+template <typename R>
+static void BM_UpdatesManyReaders(benchmark::State& state) {
+  static auto& context = StaticContext<R>();
+  absl::BlockingCounter registered(state.range(0));
+  for (int i = 0; i < state.range(0); i++) {
+    context->threads.emplace_back([&]() {
+      typename R::View local(*context->rcu);
+      registered.DecrementCount();
+      while (!context->finished.load()) {
+        benchmark::DoNotOptimize(*local.Read());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+  registered.Wait();
+  int_fast32_t updates = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(context->rcu->Update(++updates));
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK_TEMPLATE(BM_UpdatesManyReaders, CopyRcu<int_fast32_t>)
+    ->Name("BM_UpdatesManyReaders")
+    ->RangeMultiplier(4)
+    ->Range(1, 1024)
+    ->UseRealTime()
+    ->Setup([](const benchmark::State&) {
+      Setup<CopyRcu<int_fast32_t>>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<CopyRcu<int_fast32_t>>);
+
+static FanOutPool& BenchmarkFanOutPool() {
+  static FanOutPool pool(3);
+  return pool;
+}
+
+BENCHMARK_TEMPLATE(BM_UpdatesManyReaders, CopyRcu<int_fast32_t>)
+    ->Name("BM_UpdatesManyReadersSharded")
+    ->RangeMultiplier(4)
+    ->Range(1, 1024)
+    ->UseRealTime()
+    ->Setup([](const benchmark::State&) {
+      Setup<CopyRcu<int_fast32_t>>(
+          int_fast32_t{0},
+          CopyRcu<int_fast32_t>::ShardedFanOut{
+              /*shard_size=*/64, BenchmarkFanOutPool().Executor()});
+    })
+    ->Teardown(Teardown<CopyRcu<int_fast32_t>>);
+
+BENCHMARK_TEMPLATE(BM_UpdatesManyReaders, LazyCopyRcu<int_fast32_t>)
+    ->Name("BM_LazyUpdatesManyReaders")
+    ->RangeMultiplier(4)
+    ->Range(1, 1024)
+    ->UseRealTime()
+    ->Setup([](const benchmark::State&) {
+      Setup<LazyCopyRcu<int_fast32_t>>(int_fast32_t{0});
+    })
+    ->Teardown(Teardown<LazyCopyRcu<int_fast32_t>>);
 
 }  // namespace
 }  // namespace simple_rcu
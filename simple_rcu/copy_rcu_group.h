@@ -0,0 +1,348 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_COPY_RCU_GROUP_H
+#define _SIMPLE_RCU_COPY_RCU_GROUP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/utility/utility.h"
+#include "simple_rcu/copy_rcu.h"
+#include "simple_rcu/local_3state_rcu.h"
+#include "simple_rcu/thread_local.h"
+
+namespace simple_rcu {
+
+// Publishes new values of several `CopyRcu` instances as a single batch, so
+// that readers using a `CopyRcuGroup::View` observe them switch together.
+//
+// The group is a sequence counter around batches: `UpdateBatch::Commit`
+// makes it odd, distributes the values of all its `CopyRcu` instances and
+// makes it even again. A `View` accepts new values only if the counter
+// hasn't changed while it was obtaining them. Otherwise it keeps its previous
+// values, which were consistent, and so readers never wait for a batch to be
+// distributed. The only exception is a `View` that has observed a batch only
+// partially (or hasn't read anything yet), which waits until the batch
+// finishes.
+//
+// All `CopyRcu` instances read by a `View` should be updated together only
+// through the same group. They can still be updated individually by their
+// own methods, in which case readers observe such updates like with any
+// other `CopyRcu` instance.
+class CopyRcuGroup {
+ public:
+  template <typename... Ts>
+  class View;
+  class UpdateBatch;
+
+  CopyRcuGroup() : sequence_(0), lock_() {}
+  CopyRcuGroup(const CopyRcuGroup &) = delete;
+  CopyRcuGroup &operator=(const CopyRcuGroup &) = delete;
+
+ private:
+  // Incremented by `UpdateBatch::Commit` before and after distributing
+  // values. Odd while a batch is being distributed. Polled by every
+  // `View::Read()`, so it's kept on a separate cache line from `lock_`.
+  alignas(kCacheLineSize) std::atomic<uint_fast64_t> sequence_;
+  // Serializes concurrent batches.
+  alignas(kCacheLineSize) absl::Mutex lock_;
+};
+
+// Interface to a group of `CopyRcu<Ts>...` instances local to a particular
+// reader thread. It holds a `CopyRcu<T>::View` for each of them.
+// Construction and destruction are thread-safe operations, but the `Read()`
+// method is only thread-compatible. Callers are expected to construct a
+// separate `View` instance for each reader thread.
+template <typename... Ts>
+class CopyRcuGroup::View final {
+ public:
+  using Snapshots = std::tuple<typename CopyRcu<Ts>::Snapshot...>;
+
+  // Thread-safe. Argument `group` must outlive this instance, while `rcus`
+  // may not, as with `CopyRcu::View`.
+  explicit View(CopyRcuGroup &group, CopyRcu<Ts> &...rcus)
+      : group_(group), views_(rcus...), consistent_(false) {}
+
+  // Obtains read snapshots to the current values of all the `CopyRcu`
+  // instances, like `CopyRcu<T>::View::Read()` of each of them. The values
+  // are guaranteed to come either all from before, or all from after
+  // any `UpdateBatch`.
+  // Thread-compatible, but not thread-safe.
+  //
+  // Lock-free unless this `View` has observed a batch only partially during
+  // the previous call (or is new), in which case it waits until the batch
+  // finishes.
+  //
+  // While snapshots from a previous call are alive, returns the same values,
+  // since nested `CopyRcu<T>::View::Read()` calls don't advance to new values.
+  Snapshots Read() noexcept {
+    while (true) {
+      const uint_fast64_t sequence =
+          group_.sequence_.load(std::memory_order_acquire);
+      if (sequence % 2 == 1) {
+        if (consistent_) {
+          return ReadCurrent(absl::index_sequence_for<Ts...>());
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      Snapshots snapshots = ReadNew(absl::index_sequence_for<Ts...>());
+      // Ensures that if any of the above observed a value distributed by a
+      // batch, the load below observes that batch's odd `sequence_`.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      consistent_ =
+          group_.sequence_.load(std::memory_order_relaxed) == sequence;
+      if (ABSL_PREDICT_TRUE(consistent_)) {
+        return snapshots;
+      }
+    }
+  }
+
+ private:
+  template <size_t... I>
+  Snapshots ReadNew(absl::index_sequence<I...>) noexcept {
+    return Snapshots(std::get<I>(views_).Read()...);
+  }
+
+  template <size_t... I>
+  Snapshots ReadCurrent(absl::index_sequence<I...>) noexcept {
+    return Snapshots(std::get<I>(views_).ReadCurrent()...);
+  }
+
+  CopyRcuGroup &group_;
+  std::tuple<typename CopyRcu<Ts>::View...> views_;
+  // Whether the values currently held by `views_` were all obtained between
+  // two batches.
+  bool consistent_;
+};
+
+// Stages new values for several `CopyRcu` instances and distributes them in
+// a single batch.
+// Thread-compatible. Different instances can be used concurrently by
+// different threads, in which case their commits are serialized.
+class CopyRcuGroup::UpdateBatch final {
+ public:
+  explicit UpdateBatch(CopyRcuGroup &group) : group_(group), staged_() {}
+  UpdateBatch(const UpdateBatch &) = delete;
+  UpdateBatch &operator=(const UpdateBatch &) = delete;
+
+  // Stages `value` for `rcu`, replacing any value staged for it previously.
+  // Argument `rcu` must outlive `Commit`.
+  template <typename T>
+  void Stage(CopyRcu<T> &rcu, typename CopyRcu<T>::MutableT value) {
+    for (auto &staged : staged_) {
+      if (staged->Key() == &rcu) {
+        static_cast<StagedValue<T> &>(*staged).value.emplace(std::move(value));
+        return;
+      }
+    }
+    staged_.push_back(absl::make_unique<StagedValue<T>>(rcu, std::move(value)));
+  }
+
+  // Distributes all staged values to their `CopyRcu` instances and clears
+  // the batch, which can then be reused. Concurrent updates of any of the
+  // instances wait until the whole batch is distributed.
+  //
+  // Previous values are destroyed after all the instances are released.
+  void Commit() ABSL_LOCKS_EXCLUDED(group_.lock_) {
+    // Acquire the instances in a consistent order to avoid deadlocks between
+    // batches of different groups that share some of them.
+    std::sort(staged_.begin(), staged_.end(),
+              [](const std::unique_ptr<Staged> &a,
+                 const std::unique_ptr<Staged> &b) {
+                return std::less<const void *>()(a->Key(), b->Key());
+              });
+    {
+      absl::MutexLock lock(&group_.lock_);
+      for (auto &staged : staged_) {
+        staged->Lock();
+      }
+      const uint_fast64_t sequence =
+          group_.sequence_.load(std::memory_order_relaxed);
+      group_.sequence_.store(sequence + 1, std::memory_order_relaxed);
+      // Ensures that a `View` observing any of the values distributed below
+      // observes also the odd `sequence_`.
+      std::atomic_thread_fence(std::memory_order_release);
+      for (auto &staged : staged_) {
+        staged->UpdateLocked();
+      }
+      group_.sequence_.store(sequence + 2, std::memory_order_release);
+      for (auto &staged : staged_) {
+        staged->UnlockAndDrain();
+      }
+    }
+    staged_.clear();
+  }
+
+ private:
+  // A staged value for a `CopyRcu` instance of any type.
+  struct Staged {
+    virtual ~Staged() = default;
+
+    // Returns the `CopyRcu` instance this value is staged for.
+    virtual const void *Key() const = 0;
+    virtual void Lock() = 0;
+    // Distributes the staged value and keeps the previous one instead.
+    virtual void UpdateLocked() = 0;
+    virtual void UnlockAndDrain() = 0;
+  };
+
+  template <typename T>
+  struct StagedValue final : public Staged {
+    StagedValue(CopyRcu<T> &rcu_, typename CopyRcu<T>::MutableT value_)
+        : rcu(rcu_), value(absl::in_place, std::move(value_)) {}
+
+    const void *Key() const override { return &rcu; }
+    void Lock() override ABSL_NO_THREAD_SAFETY_ANALYSIS { rcu.lock_.Lock(); }
+    void UpdateLocked() override ABSL_NO_THREAD_SAFETY_ANALYSIS {
+      value.emplace(rcu.UpdateLocked(std::move(*value)));
+    }
+    void UnlockAndDrain() override ABSL_NO_THREAD_SAFETY_ANALYSIS {
+      rcu.UnlockAndDrain();
+    }
+
+    CopyRcu<T> &rcu;
+    absl::optional<typename CopyRcu<T>::MutableT> value;
+  };
+
+  CopyRcuGroup &group_;
+  std::vector<std::unique_ptr<Staged>> staged_;
+};
+
+// A fixed set of `CopyRcu<Ts>...` instances that are read together by
+// `ReadAll`, optionally consistently with the batches of a `CopyRcuGroup`.
+//
+// `ReadAll` finds the thread-local `CopyRcuGroup::View` of all the instances
+// by a single lookup in a small thread-local cache, instead of a separate
+// `GetThreadLocal` lookup for each of them. This reduces the fixed cost of
+// reading many instances, for example at the start of each request.
+//
+// Construct it with `std::make_shared`, once for all threads.
+template <typename... Ts>
+class CopyRcuReadSet final {
+ public:
+  using Snapshots = typename CopyRcuGroup::View<Ts...>::Snapshots;
+
+  // Reads `rcus`, which are kept alive by this instance. Without a
+  // `CopyRcuGroup`, values of different instances aren't necessarily
+  // consistent with each other.
+  explicit CopyRcuReadSet(std::shared_ptr<CopyRcu<Ts>>... rcus)
+      : id_(NewId()),
+        own_group_(absl::make_unique<CopyRcuGroup>()),
+        group_(*own_group_),
+        rcus_(std::move(rcus)...) {}
+  // Reads `rcus` consistently with the batches of `group`, which must outlive
+  // this instance.
+  explicit CopyRcuReadSet(CopyRcuGroup &group,
+                          std::shared_ptr<CopyRcu<Ts>>... rcus)
+      : id_(NewId()), own_group_(), group_(group), rcus_(std::move(rcus)...) {}
+  CopyRcuReadSet(const CopyRcuReadSet &) = delete;
+  CopyRcuReadSet &operator=(const CopyRcuReadSet &) = delete;
+
+  // Obtains read snapshots to the current values of all the instances of
+  // `set`, see `CopyRcuGroup::View::Read()`, using a `thread_local` `View`
+  // bound to `set`.
+  static Snapshots ReadAll(
+      const std::shared_ptr<CopyRcuReadSet> &set) noexcept {
+    return GetThreadLocal(set).Read();
+  }
+
+ private:
+  using GroupView = CopyRcuGroup::View<Ts...>;
+
+  // Maps `id_ % kThreadLocalCacheSize` to a `View` in the map of
+  // `ThreadLocal`, see `CopyRcu::GetThreadLocal`.
+  struct CacheEntry {
+    // The `id_` of the `CopyRcuReadSet` the `View` is bound to, or 0 if none.
+    uint_fast64_t id;
+    GroupView *view;
+  };
+
+  static constexpr size_t kThreadLocalCacheSize = 4;
+
+  static uint_fast64_t NewId() {
+    static std::atomic<uint_fast64_t> last_id(0);
+    return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  static CacheEntry (&ThreadLocalCache())[kThreadLocalCacheSize] {
+    static thread_local CacheEntry cache[kThreadLocalCacheSize] = {};
+    return cache;
+  }
+
+  static GroupView &GetThreadLocal(
+      const std::shared_ptr<CopyRcuReadSet> &set) noexcept {
+    CacheEntry &entry = ThreadLocalCache()[set->id_ % kThreadLocalCacheSize];
+    if (ABSL_PREDICT_TRUE(entry.id == set->id_)) {
+      // Since `id_` is never reused, `set` is alive and it holds the `View`
+      // in the thread-local map.
+      return *entry.view;
+    }
+    GroupView &view = GetThreadLocalSlow(set);
+    entry = CacheEntry{set->id_, &view};
+    return view;
+  }
+
+  static GroupView &GetThreadLocalSlow(
+      std::shared_ptr<CopyRcuReadSet> set) noexcept {
+    using Map = ThreadLocal<std::unique_ptr<GroupView>, CopyRcuReadSet>;
+    auto pair = Map::Get(std::move(set));
+    if (pair.second) {  // Inserted.
+      pair.first.local() =
+          pair.first.shared()->NewView(absl::index_sequence_for<Ts...>());
+      // Views of destroyed sets are never read again.
+      Map::CleanUp();
+    }
+    return *pair.first.local();
+  }
+
+  template <size_t... I>
+  std::unique_ptr<GroupView> NewView(absl::index_sequence<I...>) {
+    return absl::make_unique<GroupView>(group_, *std::get<I>(rcus_)...);
+  }
+
+  const uint_fast64_t id_;
+  // Set if no group has been given to the constructor.
+  const std::unique_ptr<CopyRcuGroup> own_group_;
+  CopyRcuGroup &group_;
+  const std::tuple<std::shared_ptr<CopyRcu<Ts>>...> rcus_;
+};
+
+template <typename... Ts>
+constexpr size_t CopyRcuReadSet<Ts...>::kThreadLocalCacheSize;
+
+// Obtains read snapshots of all the instances of `set` at once, see
+// `CopyRcuReadSet::ReadAll`.
+template <typename... Ts>
+inline typename CopyRcuReadSet<Ts...>::Snapshots ReadAll(
+    const std::shared_ptr<CopyRcuReadSet<Ts...>> &set) noexcept {
+  return CopyRcuReadSet<Ts...>::ReadAll(set);
+}
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_COPY_RCU_GROUP_H
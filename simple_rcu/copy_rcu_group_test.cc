@@ -0,0 +1,172 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/copy_rcu_group.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::Pointee;
+
+TEST(CopyRcuGroupTest, CommitUpdatesAll) {
+  CopyRcuGroup group;
+  CopyRcu<int> numbers(0);
+  CopyRcu<std::string> strings("");
+  CopyRcuGroup::View<int, std::string> view(group, numbers, strings);
+  CopyRcuGroup::UpdateBatch batch(group);
+  batch.Stage(numbers, 42);
+  batch.Stage(strings, "foo");
+  {
+    auto snapshots = view.Read();
+    EXPECT_THAT(std::get<0>(snapshots), Pointee(0))
+        << "Staged values must not be visible before Commit";
+    EXPECT_THAT(std::get<1>(snapshots), Pointee(std::string()));
+  }
+  batch.Commit();
+  auto snapshots = view.Read();
+  EXPECT_THAT(std::get<0>(snapshots), Pointee(42));
+  EXPECT_THAT(std::get<1>(snapshots), Pointee(std::string("foo")));
+}
+
+TEST(CopyRcuGroupTest, StageReplacesPreviousValue) {
+  CopyRcuGroup group;
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View view(rcu);
+  CopyRcuGroup::UpdateBatch batch(group);
+  batch.Stage(rcu, 1);
+  batch.Stage(rcu, 42);
+  batch.Commit();
+  EXPECT_THAT(view.Read(), Pointee(42));
+  // The batch is empty and can be reused.
+  batch.Commit();
+  EXPECT_THAT(view.Read(), Pointee(42));
+  batch.Stage(rcu, 73);
+  batch.Commit();
+  EXPECT_THAT(view.Read(), Pointee(73));
+}
+
+TEST(CopyRcuGroupTest, ReadRemainsStable) {
+  CopyRcuGroup group;
+  CopyRcu<int> first(0);
+  CopyRcu<int> second(0);
+  CopyRcuGroup::View<int, int> view(group, first, second);
+  auto snapshots = view.Read();
+  CopyRcuGroup::UpdateBatch batch(group);
+  batch.Stage(first, 42);
+  batch.Stage(second, 42);
+  batch.Commit();
+  EXPECT_THAT(std::get<0>(view.Read()), Pointee(0))
+      << "Nested reads must return the same values";
+  EXPECT_THAT(std::get<1>(snapshots), Pointee(0));
+}
+
+TEST(CopyRcuGroupTest, ConcurrentBatchesAreObservedTogether) {
+  static constexpr int kBatches = 10000;
+  CopyRcuGroup group;
+  CopyRcu<int> first(0);
+  CopyRcu<int> second(0);
+  std::atomic<bool> finished(false);
+  std::thread reader([&]() {
+    CopyRcuGroup::View<int, int> view(group, first, second);
+    int last = 0;
+    while (!finished.load()) {
+      auto snapshots = view.Read();
+      ASSERT_EQ(*std::get<0>(snapshots), *std::get<1>(snapshots));
+      ASSERT_GE(*std::get<0>(snapshots), last);
+      last = *std::get<0>(snapshots);
+    }
+  });
+  CopyRcuGroup::UpdateBatch batch(group);
+  for (int i = 1; i <= kBatches; i++) {
+    batch.Stage(first, i);
+    batch.Stage(second, i);
+    batch.Commit();
+  }
+  finished.store(true);
+  reader.join();
+}
+
+TEST(CopyRcuReadSetTest, ReadAll) {
+  auto numbers = std::make_shared<CopyRcu<int>>(1);
+  auto strings = std::make_shared<CopyRcu<std::string>>("foo");
+  auto set =
+      std::make_shared<CopyRcuReadSet<int, std::string>>(numbers, strings);
+  {
+    auto snapshots = ReadAll(set);
+    EXPECT_THAT(std::get<0>(snapshots), Pointee(1));
+    EXPECT_THAT(std::get<1>(snapshots), Pointee(std::string("foo")));
+  }
+  numbers->Update(2);
+  EXPECT_THAT(std::get<0>(ReadAll(set)), Pointee(2))
+      << "The thread-local View must observe individual updates";
+  std::thread([&set]() {
+    EXPECT_THAT(std::get<1>(ReadAll(set)), Pointee(std::string("foo")));
+  }).join();
+}
+
+TEST(CopyRcuReadSetTest, ManySetsPerThread) {
+  std::vector<std::shared_ptr<CopyRcuReadSet<int>>> sets;
+  for (int i = 0; i < 10; i++) {
+    sets.push_back(std::make_shared<CopyRcuReadSet<int>>(
+        std::make_shared<CopyRcu<int>>(i)));
+  }
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 10; i++) {
+      EXPECT_THAT(std::get<0>(ReadAll(sets[i])), Pointee(i));
+    }
+  }
+  // Replacing sets reuses cache slots and cleans up the thread-local map.
+  for (int i = 0; i < 10; i++) {
+    sets[i] = std::make_shared<CopyRcuReadSet<int>>(
+        std::make_shared<CopyRcu<int>>(-i));
+    EXPECT_THAT(std::get<0>(ReadAll(sets[i])), Pointee(-i));
+  }
+}
+
+TEST(CopyRcuReadSetTest, ConsistentWithGroup) {
+  static constexpr int kBatches = 10000;
+  CopyRcuGroup group;
+  auto first = std::make_shared<CopyRcu<int>>(0);
+  auto second = std::make_shared<CopyRcu<int>>(0);
+  auto set = std::make_shared<CopyRcuReadSet<int, int>>(group, first, second);
+  std::atomic<bool> finished(false);
+  std::thread reader([&]() {
+    while (!finished.load()) {
+      auto snapshots = ReadAll(set);
+      ASSERT_EQ(*std::get<0>(snapshots), *std::get<1>(snapshots));
+    }
+  });
+  CopyRcuGroup::UpdateBatch batch(group);
+  for (int i = 1; i <= kBatches; i++) {
+    batch.Stage(*first, i);
+    batch.Stage(*second, i);
+    batch.Commit();
+  }
+  finished.store(true);
+  reader.join();
+}
+
+}  // namespace
+}  // namespace simple_rcu
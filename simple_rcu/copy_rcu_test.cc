@@ -12,17 +12,26 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "simple_rcu/copy_rcu.h"
 
+#include "absl/memory/memory.h"
+#include "absl/types/optional.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "simple_rcu/fan_out_pool.h"
 
 namespace simple_rcu {
 namespace {
 
+using ::testing::ElementsAre;
 using ::testing::Pointee;
 
 TEST(CopyRcuTest, UpdateAndRead) {
@@ -76,6 +85,529 @@ TEST(CopyRcuTest, ReadRemainsStable) {
       << "A nested Read() must point to the same value as an outer one";
 }
 
+TEST(CopyRcuTest, SnapshotIsOnePointer) {
+  static_assert(sizeof(CopyRcu<int>::Snapshot) == sizeof(void *),
+                "Snapshot must be a single pointer");
+  static_assert(sizeof(Rcu<int>::SnapshotPtr<const int>) == sizeof(void *),
+                "SnapshotPtr must be a single pointer");
+  CopyRcu<int> rcu(42);
+  CopyRcu<int>::View local(rcu);
+  CopyRcu<int>::Snapshot moved = local.Read();
+  {
+    CopyRcu<int>::Snapshot snapshot = local.Read();
+    rcu.Update(73);
+    moved = std::move(snapshot);
+  }
+  EXPECT_THAT(moved, Pointee(42))
+      << "A moved snapshot must keep the value from advancing";
+  moved = local.Read();
+  EXPECT_THAT(moved, Pointee(42))
+      << "Assigning a nested snapshot must keep the value";
+  {
+    CopyRcu<int>::Snapshot released = std::move(moved);
+  }
+  EXPECT_THAT(local.Read(), Pointee(73))
+      << "Releasing the last snapshot must allow advancing";
+}
+
+TEST(CopyRcuTest, UpdateLatest) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View local(rcu);
+  rcu.UpdateLatest(42);
+  EXPECT_THAT(local.Read(), Pointee(42))
+      << "Uncontended UpdateLatest must distribute the value";
+  EXPECT_EQ(rcu.Update(73), 42);
+}
+
+TEST(CopyRcuTest, ConcurrentUpdateLatestKeepsLastValue) {
+  constexpr int kThreads = 4;
+  constexpr int kUpdates = 1000;
+  CopyRcu<int> rcu(-1);
+  CopyRcu<int>::View local(rcu);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&rcu, i]() {
+      for (int j = 0; j < kUpdates; j++) {
+        rcu.UpdateLatest(i * kUpdates + j);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const int last = *local.Read();
+  EXPECT_EQ(last % kUpdates, kUpdates - 1)
+      << "The last deposited value is the last value of one of the writers";
+  EXPECT_EQ(rcu.Update(-1), last)
+      << "The last deposited value must have been distributed";
+}
+
+TEST(CopyRcuTest, ViewsRegisteredDuringUpdates) {
+  constexpr int kUpdates = 10000;
+  CopyRcu<int> rcu(0);
+  std::atomic<bool> finished(false);
+  std::thread updater([&]() {
+    for (int i = 1; i <= kUpdates; i++) {
+      rcu.Update(i);
+    }
+    finished.store(true);
+  });
+  bool updater_finished;
+  do {
+    updater_finished = finished.load();
+    CopyRcu<int>::View local(rcu);
+    int previous = *local.Read();
+    for (int i = 0; i < 10; i++) {
+      const int current = *local.Read();
+      ASSERT_GE(current, previous) << "Values must never go back";
+      previous = current;
+    }
+    if (updater_finished) {
+      EXPECT_EQ(previous, kUpdates) << "Must receive the last value";
+    }
+  } while (!updater_finished);
+  updater.join();
+}
+
+TEST(CopyRcuTest, ShardedFanOut) {
+  FanOutPool pool(3);
+  CopyRcu<int> rcu(0, {/*shard_size=*/8, pool.Executor()});
+  std::vector<std::unique_ptr<CopyRcu<int>::View>> locals;
+  for (int i = 0; i < 100; i++) {
+    locals.push_back(absl::make_unique<CopyRcu<int>::View>(rcu));
+  }
+  for (int i = 1; i <= 3; i++) {
+    EXPECT_EQ(rcu.Update(i), i - 1);
+    for (auto &local : locals) {
+      EXPECT_THAT(local->Read(), Pointee(i))
+          << "Each View must receive the value from its shard";
+    }
+  }
+}
+
+// Counts its copies, so that tests can verify values are modified in place.
+struct CountedCopies {
+  CountedCopies() : value(0) {}
+  CountedCopies(const CountedCopies &other) : value(other.value) { copies++; }
+  CountedCopies &operator=(const CountedCopies &other) {
+    value = other.value;
+    copies++;
+    return *this;
+  }
+
+  static int copies;
+  int value;
+};
+int CountedCopies::copies = 0;
+
+TEST(CopyRcuTest, UpdateWith) {
+  CopyRcu<std::vector<int>> rcu;
+  CopyRcu<std::vector<int>>::View active(rcu);
+  CopyRcu<std::vector<int>>::View idle(rcu);
+  for (int i = 0; i < 10; i++) {
+    rcu.UpdateWith([i](std::vector<int> &value) { value.push_back(i); });
+    EXPECT_EQ(active.Read()->size(), i + 1);
+    EXPECT_EQ(active.Read()->back(), i);
+  }
+  EXPECT_THAT(*idle.Read(), ElementsAre(0, 1, 2, 3, 4, 5, 6, 7, 8, 9));
+  CopyRcu<std::vector<int>>::View registered_later(rcu);
+  EXPECT_EQ(registered_later.Read()->size(), 10);
+  rcu.Update({42});
+  rcu.UpdateWith([](std::vector<int> &value) { value.push_back(73); });
+  EXPECT_THAT(*active.Read(), ElementsAre(42, 73));
+  EXPECT_THAT(*idle.Read(), ElementsAre(42, 73));
+  EXPECT_THAT(*registered_later.Read(), ElementsAre(42, 73));
+}
+
+TEST(CopyRcuTest, UpdateWithDoesntCopy) {
+  CopyRcu<CountedCopies> rcu;
+  CopyRcu<CountedCopies>::View active(rcu);
+  CopyRcu<CountedCopies>::View idle(rcu);
+  // Ensure that all the internal instances have been brought up to date.
+  for (int i = 1; i <= 5; i++) {
+    rcu.UpdateWith([](CountedCopies &counted) { counted.value++; });
+    EXPECT_EQ(active.Read()->value, i);
+  }
+  const int copies = CountedCopies::copies;
+  for (int i = 6; i <= 100; i++) {
+    rcu.UpdateWith([](CountedCopies &counted) { counted.value++; });
+    EXPECT_EQ(active.Read()->value, i);
+  }
+  EXPECT_EQ(idle.Read()->value, 100);
+  EXPECT_EQ(CountedCopies::copies, copies)
+      << "Values must be modified in place";
+}
+
+// Returns the number of copies made by `updates` calls to `Update` of a
+// `CopyRcu` with an active `View` and `idle` ones.
+int CopiesByUpdates(int updates, int idle) {
+  CopyRcu<CountedCopies> rcu;
+  CopyRcu<CountedCopies>::View active(rcu);
+  std::vector<std::unique_ptr<CopyRcu<CountedCopies>::View>> idle_views;
+  for (int i = 0; i < idle; i++) {
+    idle_views.push_back(absl::make_unique<CopyRcu<CountedCopies>::View>(rcu));
+  }
+  const int copies = CountedCopies::copies;
+  CountedCopies value;
+  for (int i = 1; i <= updates; i++) {
+    value.value = i;
+    rcu.Update(value);
+    EXPECT_EQ(active.Read()->value, i);
+  }
+  const int result = CountedCopies::copies - copies;
+  for (auto &view : idle_views) {
+    EXPECT_EQ(view->Read()->value, updates) << "Must pull the latest value";
+  }
+  return result;
+}
+
+TEST(CopyRcuTest, UpdateDefersCopiesToIdleViews) {
+  EXPECT_LE(CopiesByUpdates(100, 10), CopiesByUpdates(100, 0) + 10)
+      << "Each idle View must receive at most a single copy";
+}
+
+TEST(CopyRcuTest, IdleViewPullsLatestValue) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View idle(rcu);
+  rcu.Update(1);
+  rcu.Update(2);  // Deferred.
+  rcu.Update(3);  // Deferred.
+  EXPECT_FALSE(rcu.ReadersPassed(3));
+  EXPECT_TRUE(idle.WaitForUpdate(absl::ZeroDuration()))
+      << "A pending pull must count as a new value";
+  {
+    auto snapshot = idle.Read();
+    EXPECT_EQ(*snapshot, 3);
+    EXPECT_EQ(snapshot.version(), 3u);
+    rcu.Update(4);
+    EXPECT_EQ(*idle.Read(), 3) << "Nested snapshots must not pull";
+  }
+  EXPECT_TRUE(rcu.ReadersPassed(3));
+  EXPECT_EQ(*idle.Read(), 4);
+  rcu.Update(5);
+  rcu.Update(6);  // Deferred.
+  int notified = 0;
+  idle.NotifyOnUpdate([&notified]() { notified++; });
+  EXPECT_EQ(notified, 1) << "A pending pull must count as a new value";
+  EXPECT_EQ(*idle.Read(), 6);
+  EXPECT_FALSE(idle.WaitForUpdate(absl::ZeroDuration()));
+  rcu.Update(7);
+  EXPECT_TRUE(idle.WaitForUpdate(absl::ZeroDuration()));
+  EXPECT_EQ(*idle.Read(), 7);
+}
+
+TEST(CopyRcuTest, ViewWithPendingPullOutlivesRcu) {
+  auto rcu = std::make_shared<CopyRcu<int>>(0);
+  CopyRcu<int>::View local(rcu);
+  rcu->Update(1);
+  rcu->Update(2);  // Deferred.
+  rcu.reset();
+  EXPECT_THAT(local.Read(), Pointee(2))
+      << "Destruction must deliver values pending a pull";
+}
+
+TEST(CopyRcuTest, ReadsWhileDestroyingRcuWithPendingPulls) {
+  for (int i = 0; i < 100; i++) {
+    auto rcu = std::make_shared<CopyRcu<int>>(0);
+    CopyRcu<int>::View local(rcu);
+    std::thread reader([&local]() {
+      while (*local.Read() != 3) {
+      }
+    });
+    rcu->Update(1);
+    rcu->Update(2);
+    rcu->Update(3);
+    rcu.reset();
+    reader.join();
+  }
+}
+
+TEST(CopyRcuTest, ConcurrentReadsOfIdleViews) {
+  CopyRcu<int> rcu(0);
+  std::atomic<bool> finished(false);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&rcu, &finished]() {
+      CopyRcu<int>::View view(rcu);
+      int previous = 0;
+      while (!finished.load()) {
+        auto snapshot = view.Read();
+        EXPECT_GE(*snapshot, previous) << "Values must never go back";
+        EXPECT_EQ(static_cast<uint_fast64_t>(*snapshot), snapshot.version());
+        previous = *snapshot;
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (int i = 1; i <= 10000; i++) {
+    rcu.Update(i);
+  }
+  finished.store(true);
+  for (auto &reader : readers) {
+    reader.join();
+  }
+}
+
+TEST(CopyRcuTest, UpdateWithFactory) {
+  CopyRcu<std::vector<int>> rcu;
+  CopyRcu<std::vector<int>>::View local1(rcu);
+  CopyRcu<std::vector<int>>::View local2(rcu);
+  int calls = 0;
+  rcu.Update([&calls]() {
+    calls++;
+    return std::vector<int>{42};
+  });
+  EXPECT_EQ(calls, 3) << "Once for each View and once for the kept value";
+  EXPECT_THAT(*local1.Read(), ElementsAre(42));
+  EXPECT_THAT(*local2.Read(), ElementsAre(42));
+  CopyRcu<std::vector<int>>::View local3(rcu);
+  EXPECT_THAT(*local3.Read(), ElementsAre(42));
+  EXPECT_EQ(calls, 3) << "Copyable values of new Views are just copied";
+}
+
+TEST(CopyRcuTest, MoveOnlyValues) {
+  CopyRcu<std::unique_ptr<const int>> rcu(
+      []() { return absl::make_unique<const int>(0); });
+  CopyRcu<std::unique_ptr<const int>>::View local1(rcu);
+  EXPECT_THAT(local1.ReadPtr(), Pointee(0));
+  std::unique_ptr<const int> previous =
+      rcu.Update([]() { return absl::make_unique<const int>(42); });
+  EXPECT_THAT(previous, Pointee(0));
+  CopyRcu<std::unique_ptr<const int>>::View local2(rcu);
+  EXPECT_THAT(local1.ReadPtr(), Pointee(42));
+  EXPECT_THAT(local2.ReadPtr(), Pointee(42))
+      << "View registered after Update must receive the value from `make`";
+  EXPECT_NE(local1.ReadPtr().get(), local2.ReadPtr().get())
+      << "Each View must have its own instance";
+}
+
+TEST(CopyRcuTest, ViewOutlivesRcu) {
+  auto rcu = std::make_shared<CopyRcu<int>>(42);
+  CopyRcu<int>::View local(rcu);
+  rcu.reset();
+  EXPECT_THAT(local.Read(), Pointee(42))
+      << "View must keep its last value after its RCU is destroyed";
+}
+
+TEST(CopyRcuTest, Versions) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View local(rcu);
+  EXPECT_EQ(rcu.Version(), 0u);
+  EXPECT_EQ(local.Read().version(), 0u);
+  rcu.Update(1);
+  rcu.UpdateWith([](int &value) { value++; });
+  EXPECT_EQ(rcu.Version(), 2u);
+  auto snapshot = local.Read();
+  EXPECT_THAT(snapshot, Pointee(2));
+  EXPECT_EQ(snapshot.version(), 2u);
+  rcu.Update(3);
+  EXPECT_EQ(local.Read().version(), 2u)
+      << "Nested snapshots must have the same version";
+}
+
+TEST(CopyRcuTest, ReadersPassed) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View local(rcu);
+  EXPECT_TRUE(rcu.ReadersPassed(rcu.Version()));
+  rcu.Update(1);
+  EXPECT_FALSE(rcu.ReadersPassed(1)) << "The View hasn't read yet";
+  EXPECT_TRUE(rcu.ReadersPassed(0));
+  {
+    auto snapshot = local.Read();
+    rcu.Update(2);
+    EXPECT_TRUE(rcu.ReadersPassed(1));
+    EXPECT_FALSE(rcu.ReadersPassed(2));
+    local.Read();
+    EXPECT_FALSE(rcu.ReadersPassed(2))
+        << "Nested reads must not advance the View";
+  }
+  local.Read();
+  EXPECT_TRUE(rcu.ReadersPassed(2));
+  rcu.Update(3);
+  {
+    CopyRcu<int>::View idle(rcu);
+    EXPECT_FALSE(rcu.ReadersPassed(3));
+  }
+  EXPECT_FALSE(rcu.ReadersPassed(3));
+  local.Read();
+  EXPECT_TRUE(rcu.ReadersPassed(3))
+      << "A destroyed View must not be waited for";
+}
+
+TEST(CopyRcuTest, Synchronize) {
+  CopyRcu<int> rcu(0);
+  std::atomic<bool> registered(false);
+  std::atomic<bool> finished(false);
+  std::atomic<int> last_read(0);
+  std::thread reader([&]() {
+    CopyRcu<int>::View local(rcu);
+    registered.store(true);
+    while (!finished.load()) {
+      last_read.store(*local.Read());
+    }
+  });
+  while (!registered.load()) {
+    std::this_thread::yield();
+  }
+  for (int i = 1; i <= 20; i++) {
+    rcu.Update(i);
+    EXPECT_EQ(rcu.Synchronize(), static_cast<uint_fast64_t>(i));
+    EXPECT_GE(last_read.load(), i - 1)
+        << "The reader must have read the value of the Update";
+  }
+  finished.store(true);
+  reader.join();
+}
+
+TEST(CopyRcuTest, PinnedIsNotTiedToItsThread) {
+  CopyRcu<int> rcu(42);
+  CopyRcu<int>::View local(rcu);
+  CopyRcu<int>::Pinned pinned = local.Pin();
+  rcu.Update(73);
+  EXPECT_THAT(local.Read(), Pointee(73))
+      << "A pinned value must not keep its View from advancing";
+  EXPECT_EQ(*pinned, 42);
+  EXPECT_EQ(pinned.version(), 0u);
+  std::thread([&pinned]() {
+    CopyRcu<int>::Pinned moved = std::move(pinned);
+    EXPECT_EQ(*moved, 42);
+  }).join();
+  EXPECT_EQ(rcu.Synchronize(), 1u)
+      << "Pins released by another thread must not be waited for";
+}
+
+TEST(CopyRcuTest, PinnedDoesNotKeepItsDestroyedViewRegistered) {
+  CopyRcu<int> rcu(42);
+  absl::optional<CopyRcu<int>::View> view(absl::in_place, rcu);
+  CopyRcu<int>::Pinned pinned = view->Pin();
+  view.reset();
+  rcu.Update(73);
+  EXPECT_TRUE(rcu.ReadersPassed(rcu.Version()))
+      << "A destroyed View must not be waited for";
+  EXPECT_EQ(rcu.Stats().views, 0u);
+  EXPECT_EQ(*pinned, 42);
+}
+
+TEST(CopyRcuTest, SynchronizeWaitsForPins) {
+  const auto rcu = std::make_shared<Rcu<int>>(std::make_shared<int>(0));
+  absl::optional<Rcu<int>::Pinned> pinned(Pin(rcu));
+  EXPECT_THAT(**pinned, Pointee(0));
+  rcu->Update(std::make_shared<int>(1));
+  EXPECT_THAT(ReadPtr(rcu), Pointee(1));
+  std::atomic<bool> synchronized(false);
+  std::thread synchronizer([&]() {
+    rcu->Synchronize();
+    synchronized.store(true);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(synchronized.load())
+      << "Synchronize must wait for a pre-existing pinned value";
+  pinned.reset();
+  synchronizer.join();
+  EXPECT_TRUE(synchronized.load());
+}
+
+TEST(CopyRcuTest, WaitForUpdate) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View reader(rcu);
+  EXPECT_FALSE(reader.WaitForUpdate(absl::Milliseconds(1)));
+  rcu.Update(1);
+  EXPECT_TRUE(reader.WaitForUpdate(absl::ZeroDuration()))
+      << "Must not wait when a new value is available";
+  EXPECT_EQ(*reader.Read(), 1);
+  std::thread updater([&rcu]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    rcu.Update(2);
+  });
+  EXPECT_TRUE(reader.WaitForUpdate());
+  EXPECT_EQ(*reader.Read(), 2);
+  updater.join();
+}
+
+TEST(CopyRcuTest, NotifyOnUpdate) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View reader(rcu);
+  int notified = 0;
+  reader.NotifyOnUpdate([&notified]() { notified++; });
+  EXPECT_EQ(notified, 0);
+  rcu.Update(1);
+  EXPECT_EQ(notified, 1);
+  rcu.Update(2);
+  EXPECT_EQ(notified, 1) << "The callback must be called only once";
+  reader.NotifyOnUpdate([&notified]() { notified++; });
+  EXPECT_EQ(notified, 2) << "Must be called right away if a value is ready";
+  EXPECT_EQ(*reader.Read(), 2);
+}
+
+TEST(CopyRcuTest, Stats) {
+  CopyRcu<int, WithStats> rcu(0);
+  CopyRcu<int, WithStats>::View reader(rcu);
+  {
+    CopyRcu<int, WithStats>::View idle(rcu);
+    EXPECT_EQ(rcu.Stats().views, 2u);
+    idle.Read();
+    rcu.Update(1);
+    reader.Read();
+    rcu.Update(2);
+  }
+  EXPECT_EQ(rcu.Stats().views, 1u);
+  rcu.Update(3);
+  reader.Read();
+  reader.Read();
+  const RcuStats stats = rcu.Stats();
+  EXPECT_EQ(stats.views, 1u);
+  EXPECT_EQ(stats.reads, 4u) << "Reads of destroyed Views must be kept";
+  EXPECT_EQ(stats.reads_with_new_value, 2u);
+  EXPECT_EQ(stats.updates, 3u);
+  EXPECT_EQ(stats.pushes, 5u);
+  EXPECT_EQ(stats.pushes_unread, 2u)
+      << "Value 1 to the destroyed View and 2 to `reader` were never read";
+  EXPECT_LE(stats.max_update_nanos, stats.update_nanos);
+}
+
+TEST(CopyRcuTest, NoStats) {
+  CopyRcu<int> rcu(0);
+  CopyRcu<int>::View reader(rcu);
+  rcu.Update(1);
+  reader.Read();
+  const RcuStats stats = rcu.Stats();
+  EXPECT_EQ(stats.views, 1u);
+  EXPECT_EQ(stats.reads, 0u);
+  EXPECT_EQ(stats.updates, 0u);
+}
+
+TEST(CopyRcuTest, Policies) {
+  using Policy = CopyRcuPolicy<WithStats, CacheLinePaddedLayout, SpinLock>;
+  static_assert(std::is_same<CopyRcuLayoutOf<NoStats>::type,
+                             CompactLayout>::value,
+                "Stats policies must keep the default layout");
+  static_assert(std::is_same<CopyRcuUpdateMutexOf<Policy>::type,
+                             SpinLock>::value,
+                "");
+  CopyRcu<int, Policy> rcu(0);
+  CopyRcu<int, Policy>::View reader(rcu);
+  std::vector<std::thread> updaters;
+  for (int i = 1; i <= 4; i++) {
+    updaters.emplace_back([&rcu, i]() {
+      for (int j = 0; j < 100; j++) {
+        if (j % 2 == 0) {
+          rcu.Update(i);
+        } else {
+          rcu.UpdateLatest(i);
+        }
+        rcu.UpdateWith([](int &value) { value += 0; });
+      }
+    });
+  }
+  for (auto &updater : updaters) {
+    updater.join();
+  }
+  const int value = *reader.Read();
+  EXPECT_GE(value, 1);
+  EXPECT_LE(value, 4);
+  EXPECT_EQ(rcu.Stats().reads, 1u) << "Stats must follow the stats policy";
+}
+
 TEST(RcuTest, UpdateAndReadPtr) {
   Rcu<int> rcu;
   Rcu<int>::View local1(rcu);
@@ -88,6 +620,8 @@ TEST(RcuTest, UpdateAndReadPtr) {
       << "Thread registered after Update must also receive the value";
   EXPECT_EQ(local1.ReadPtr(), local2.ReadPtr())
       << "Both pointer snapshots must point to the shared value";
+  rcu.Update(nullptr);
+  EXPECT_EQ(local1.ReadPtr(), nullptr);
 }
 
 TEST(CopyRcuTest, ThreadLocalUpdateAndRead) {
@@ -104,5 +638,26 @@ TEST(CopyRcuTest, ThreadLocalUpdateAndRead) {
   EXPECT_EQ(Rcu<int>::CleanUpThreadLocal(), 0);
 }
 
+TEST(CopyRcuTest, ThreadLocalManyInstances) {
+  std::vector<std::shared_ptr<CopyRcu<int>>> rcus;
+  for (int i = 0; i < 20; i++) {
+    rcus.push_back(std::make_shared<CopyRcu<int>>(i));
+  }
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 20; i++) {
+      EXPECT_THAT(Read(rcus[i]), Pointee(i + round));
+      rcus[i]->Update(i + round + 1);
+    }
+  }
+}
+
+TEST(CopyRcuTest, ThreadLocalInstanceReplaced) {
+  for (int i = 0; i < 10; i++) {
+    // Likely to reuse the memory location of the previous instance.
+    const auto rcu = std::make_shared<CopyRcu<int>>(i);
+    EXPECT_THAT(Read(rcu), Pointee(i));
+  }
+}
+
 }  // namespace
 }  // namespace simple_rcu
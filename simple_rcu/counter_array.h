@@ -0,0 +1,68 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_COUNTER_ARRAY_H
+#define _SIMPLE_RCU_COUNTER_ARRAY_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace simple_rcu {
+
+// A fixed number of counters, indexed by slots in [0, `N`), for collecting
+// metrics with many labels through `ReverseRcu<CounterArray<N>>`.
+//
+// Unlike a per-thread map from labels to counters, it never allocates:
+// Writers just increment a slot of their `View`, and `Collect` combines whole
+// arrays with a plain loop over contiguous counters, which compilers
+// vectorize. Labels are expected to be mapped to slots once, for example
+// when registering them, rather than on each write.
+//
+// For latency distributions see `LatencyHistogram`, which can be collected
+// the same way.
+//
+// Thread-compatible.
+template <size_t N>
+class CounterArray {
+ public:
+  static constexpr size_t kSize = N;
+
+  CounterArray() : counters_() {}
+
+  // `slot` must be less than `N`.
+  void Add(size_t slot, uint64_t delta = 1) noexcept {
+    counters_[slot] += delta;
+  }
+
+  uint64_t operator[](size_t slot) const noexcept { return counters_[slot]; }
+  static constexpr size_t size() noexcept { return N; }
+
+  CounterArray& operator+=(const CounterArray& other) noexcept {
+    for (size_t i = 0; i < N; i++) {
+      counters_[i] += other.counters_[i];
+    }
+    return *this;
+  }
+
+ private:
+  std::array<uint64_t, N> counters_;
+};
+
+template <size_t N>
+constexpr size_t CounterArray<N>::kSize;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_COUNTER_ARRAY_H
@@ -0,0 +1,79 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/counter_array.h"
+
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "simple_rcu/fan_out_pool.h"
+#include "simple_rcu/latency_histogram.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(CounterArrayTest, AddAndMerge) {
+  CounterArray<4> first;
+  CounterArray<4> second;
+  EXPECT_EQ(first.size(), 4u);
+  first.Add(0);
+  first.Add(3, 5);
+  second.Add(3, 2);
+  second.Add(1);
+  first += second;
+  EXPECT_EQ(first[0], 1u);
+  EXPECT_EQ(first[1], 1u);
+  EXPECT_EQ(first[2], 0u);
+  EXPECT_EQ(first[3], 7u);
+}
+
+TEST(CounterArrayTest, ShardedCollect) {
+  FanOutPool pool(3);
+  using Counters = CounterArray<16>;
+  ReverseRcu<Counters> rcu(
+      ReverseRcu<Counters>::ShardedCollect{/*shard_size=*/4, pool.Executor()});
+  std::vector<std::unique_ptr<ReverseRcu<Counters>::View>> locals;
+  for (int i = 0; i < 50; i++) {
+    locals.push_back(std::unique_ptr<ReverseRcu<Counters>::View>(
+        new ReverseRcu<Counters>::View(rcu)));
+    locals.back()->Write()->Add(i % Counters::kSize);
+  }
+  const Counters collected = rcu.Collect();
+  for (size_t slot = 0; slot < Counters::kSize; slot++) {
+    EXPECT_EQ(collected[slot], slot < 50 % Counters::kSize ? 4u : 3u) << slot;
+  }
+  EXPECT_EQ(rcu.Collect()[0], 0u);
+}
+
+TEST(CounterArrayTest, ShardedCollectLatencyHistograms) {
+  FanOutPool pool(3);
+  ReverseRcu<LatencyHistogram> rcu(ReverseRcu<LatencyHistogram>::ShardedCollect{
+      /*shard_size=*/2, pool.Executor()});
+  std::vector<std::unique_ptr<ReverseRcu<LatencyHistogram>::View>> locals;
+  for (int i = 1; i <= 9; i++) {
+    locals.push_back(std::unique_ptr<ReverseRcu<LatencyHistogram>::View>(
+        new ReverseRcu<LatencyHistogram>::View(rcu)));
+    locals.back()->Write()->Record(i);
+  }
+  const LatencyHistogram collected = rcu.Collect();
+  EXPECT_EQ(collected.count(), 9u);
+  EXPECT_EQ(collected.min(), 1u);
+  EXPECT_EQ(collected.max(), 9u);
+  EXPECT_EQ(collected.Percentile(50), 5u);
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,214 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_COW_VECTOR_H
+#define _SIMPLE_RCU_COW_VECTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace simple_rcu {
+
+// A vector with value semantics whose elements are stored in immutable,
+// reference-counted chunks of `kChunkSize` elements, shared between copies.
+//
+// Copying a `CowVector` copies a single `shared_ptr` to its chunk index.
+// Modifying a copy first clones the index and the modified chunk, if they're
+// shared with other copies (copy-on-write), so that a modification of a
+// single element costs O(size() / kChunkSize + kChunkSize) and allocates a
+// new index and chunk at most.
+//
+// This makes it suitable for `CopyRcu<CowVector<E>>`: Each `View` keeps three
+// instances, which are then just a few pointers each, all sharing the same
+// chunks, instead of three deep copies per `View`. The readers' view of the
+// value is unchanged. To modify the value, modify a copy of the current value
+// and pass it to `Update`, which then distributes only the handles:
+//
+//   CowVector<Rule> rules = *view.Read();
+//   rules.Set(i, new_rule);
+//   rcu.Update(std::move(rules));
+//
+// Avoid `CopyRcu::UpdateWith`, as it would apply the mutator to each `View`'s
+// instance separately, cloning the modified chunk for each of them.
+//
+// Thread-compatible: Distinct instances can be modified concurrently, even if
+// they share chunks, which are never modified while shared.
+// A moved-from instance may only be destroyed or assigned to.
+template <typename E, size_t kChunkSize = 512>
+class CowVector {
+ private:
+  using Chunk = std::vector<E>;
+  using Index = std::vector<std::shared_ptr<Chunk>>;
+
+ public:
+  static_assert(kChunkSize > 0, "Chunks must hold at least one element");
+
+  using value_type = E;
+  using size_type = size_t;
+
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = E;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const E *;
+    using reference = const E &;
+
+    const_iterator() : vector_(nullptr), i_(0) {}
+
+    reference operator*() const { return (*vector_)[i_]; }
+    pointer operator->() const { return &(*vector_)[i_]; }
+    const_iterator &operator++() {
+      i_++;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator previous = *this;
+      i_++;
+      return previous;
+    }
+    bool operator==(const const_iterator &other) const {
+      return i_ == other.i_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return i_ != other.i_;
+    }
+
+   private:
+    const_iterator(const CowVector &vector, size_t i)
+        : vector_(&vector), i_(i) {}
+
+    const CowVector *vector_;
+    size_t i_;
+
+    friend class CowVector;
+  };
+
+  CowVector() : index_(std::make_shared<Index>()), size_(0) {}
+  CowVector(std::initializer_list<E> elements) : CowVector() {
+    for (const E &element : elements) {
+      push_back(element);
+    }
+  }
+  template <typename InputIt>
+  CowVector(InputIt first, InputIt last) : CowVector() {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+
+  const E &operator[](size_t i) const noexcept {
+    return (*(*index_)[i / kChunkSize])[i % kChunkSize];
+  }
+  const_iterator begin() const { return const_iterator(*this, 0); }
+  const_iterator end() const { return const_iterator(*this, size_); }
+
+  // Replaces the element at `i`, which must be less than `size()`.
+  void Set(size_t i, E value) { Mutable(i) = std::move(value); }
+  // Returns a mutable reference to the element at `i`, which must be less
+  // than `size()`, after unsharing its chunk. The reference is invalidated by
+  // copying this instance and by any modification of it.
+  E &Mutable(size_t i) {
+    return (*MutableChunk(i / kChunkSize))[i % kChunkSize];
+  }
+
+  void push_back(E value) {
+    if (size_ % kChunkSize == 0) {
+      auto chunk = std::make_shared<Chunk>();
+      chunk->reserve(kChunkSize);
+      chunk->push_back(std::move(value));
+      MutableIndex().push_back(std::move(chunk));
+    } else {
+      MutableChunk(size_ / kChunkSize)->push_back(std::move(value));
+    }
+    size_++;
+  }
+  // `size()` must be positive.
+  void pop_back() {
+    size_--;
+    if (size_ % kChunkSize == 0) {
+      MutableIndex().pop_back();
+    } else {
+      MutableChunk(size_ / kChunkSize)->pop_back();
+    }
+  }
+
+  // Whether the element at `i` of this instance and of `other` is stored in
+  // the same shared chunk. Mainly for testing.
+  bool SharesChunk(const CowVector &other, size_t i) const noexcept {
+    return (*index_)[i / kChunkSize] == (*other.index_)[i / kChunkSize];
+  }
+
+  friend bool operator==(const CowVector &a, const CowVector &b) {
+    if (a.size_ != b.size_) {
+      return false;
+    }
+    for (size_t i = 0; i < a.size_; i++) {
+      if (!(a.SharesChunk(b, i) || a[i] == b[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  friend bool operator!=(const CowVector &a, const CowVector &b) {
+    return !(a == b);
+  }
+
+ private:
+  // Whether `ptr` is held only by this instance.
+  template <typename U>
+  static bool Unique(const std::shared_ptr<U> &ptr) noexcept {
+    if (ptr.use_count() != 1) {
+      return false;
+    }
+    // `use_count()` is a relaxed load. Synchronize with the release of the
+    // other owners, so that their accesses happen before our modifications.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+  }
+
+  Index &MutableIndex() {
+    if (!Unique(index_)) {
+      index_ = std::make_shared<Index>(*index_);
+    }
+    return *index_;
+  }
+
+  Chunk *MutableChunk(size_t chunk) {
+    std::shared_ptr<Chunk> &ptr = MutableIndex()[chunk];
+    if (!Unique(ptr)) {
+      auto copy = std::make_shared<Chunk>();
+      copy->reserve(kChunkSize);
+      copy->insert(copy->end(), ptr->begin(), ptr->end());
+      ptr = std::move(copy);
+    }
+    return ptr.get();
+  }
+
+  // Never `nullptr`. Chunks are full except for the last one.
+  std::shared_ptr<Index> index_;
+  size_t size_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_COW_VECTOR_H
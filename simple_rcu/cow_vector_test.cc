@@ -0,0 +1,97 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/cow_vector.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(CowVectorTest, PushAndPop) {
+  CowVector<int, 2> vector;
+  EXPECT_TRUE(vector.empty());
+  for (int i = 0; i < 5; i++) {
+    vector.push_back(i);
+  }
+  EXPECT_EQ(vector.size(), 5u);
+  EXPECT_THAT(vector, ElementsAre(0, 1, 2, 3, 4));
+  vector.pop_back();
+  vector.pop_back();
+  EXPECT_THAT(vector, ElementsAre(0, 1, 2));
+  vector.push_back(7);
+  EXPECT_THAT(vector, ElementsAre(0, 1, 2, 7));
+}
+
+TEST(CowVectorTest, CopiesShareUnmodifiedChunks) {
+  const CowVector<std::string, 2> original{"a", "b", "c", "d", "e"};
+  CowVector<std::string, 2> copy = original;
+  for (size_t i = 0; i < copy.size(); i++) {
+    EXPECT_TRUE(copy.SharesChunk(original, i));
+  }
+  copy.Set(3, "x");
+  copy.push_back("f");
+  EXPECT_THAT(original, ElementsAre("a", "b", "c", "d", "e"));
+  EXPECT_THAT(copy, ElementsAre("a", "b", "c", "x", "e", "f"));
+  EXPECT_TRUE(copy.SharesChunk(original, 0));
+  EXPECT_FALSE(copy.SharesChunk(original, 2)) << "Chunk 1 must be unshared";
+  EXPECT_FALSE(copy.SharesChunk(original, 4)) << "Chunk 2 must be unshared";
+  EXPECT_NE(copy, original);
+  copy.Set(3, "d");
+  copy.pop_back();
+  EXPECT_EQ(copy, original);
+}
+
+TEST(CowVectorTest, UniqueChunksAreModifiedInPlace) {
+  CowVector<int, 4> vector{1, 2, 3};
+  const int *element = &vector[1];
+  vector.Mutable(1) = 5;
+  vector.push_back(4);
+  EXPECT_EQ(&vector[1], element);
+  EXPECT_THAT(vector, ElementsAre(1, 5, 3, 4));
+}
+
+TEST(CowVectorTest, ViewsShareStorage) {
+  const std::vector<int> elements(10000, 42);
+  CopyRcu<CowVector<int>> rcu(
+      CowVector<int>(elements.begin(), elements.end()));
+  CopyRcu<CowVector<int>>::View view1(rcu);
+  CopyRcu<CowVector<int>>::View view2(rcu);
+  {
+    CowVector<int> updated = *view1.Read();
+    updated.Set(0, 73);
+    rcu.Update(std::move(updated));
+  }
+  std::thread reader([&view2]() {
+    auto snapshot = view2.Read();
+    EXPECT_EQ((*snapshot)[0], 73);
+    EXPECT_EQ((*snapshot)[9999], 42);
+  });
+  reader.join();
+  auto snapshot1 = view1.Read();
+  auto snapshot2 = view2.Read();
+  EXPECT_EQ(&(*snapshot1)[0], &(*snapshot2)[0]);
+  EXPECT_EQ(&(*snapshot1)[9999], &(*snapshot2)[9999]);
+}
+
+}  // namespace
+}  // namespace simple_rcu
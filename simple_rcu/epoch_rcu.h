@@ -0,0 +1,268 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_EPOCH_RCU_H
+#define _SIMPLE_RCU_EPOCH_RCU_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace simple_rcu {
+
+// Epoch-based RCU of `const T` values with the same reading interface as
+// `Rcu<T>`.
+//
+// Unlike `Rcu<T>`, which distributes a `shared_ptr` to every `View`, there is
+// just a single atomic pointer to the current value. Each `View` only
+// announces the epoch in which it started reading, so it needs O(1) memory and
+// there is no reference counting when reading. Values replaced by `Update` are
+// destroyed once no `View` that might still observe them is reading, either
+// by a subsequent `Update` or by an explicit call to `Reclaim`, for example
+// from a background thread.
+//
+// The price is that a `View` holding a `Snapshot` for a long time delays the
+// destruction of all values replaced in the meantime.
+template <typename T>
+class EpochRcu {
+ public:
+  class View;
+
+  template <typename U = const T>
+  class SnapshotDeleter {
+   public:
+    SnapshotDeleter(const SnapshotDeleter &) noexcept = default;
+    SnapshotDeleter &operator=(const SnapshotDeleter &) noexcept = default;
+
+    void operator()(U *) { registrar_.Release(); }
+
+   private:
+    SnapshotDeleter(View &registrar) noexcept : registrar_(registrar) {}
+
+    View &registrar_;
+
+    friend class View;
+  };
+
+  // Holds a read reference to a RCU value for the current thread.
+  // The reference is guaranteed to be stable during the lifetime of `Snapshot`.
+  // Callers are expected to limit the lifetime of `Snapshot` to as short as
+  // possible.
+  // WARNING: Bad things will happen if you use `reset` on a `Snapshot`.
+  // Thread-compatible (but not thread-safe), reentrant.
+  using Snapshot = std::unique_ptr<const T, SnapshotDeleter<>>;
+
+  // Interface to the RCU local to a particular reader thread.
+  // Construction and destruction are thread-safe operations, but the
+  // `ReadPtr()` method is only thread-compatible. Callers are expected to
+  // construct a separate `View` instance for each reader thread.
+  class View final {
+   public:
+    // Thread-safe. Argument `rcu` must outlive this instance.
+    View(EpochRcu &rcu)
+        : rcu_(rcu),
+          snapshot_depth_(0),
+          snapshot_(nullptr),
+          slot_(rcu.Register()) {}
+    View(const std::shared_ptr<EpochRcu> &rcu) : View(*rcu) {}
+
+    // Obtains a read snapshot to the current value held by the RCU.
+    // Returns `nullptr` if the current value is `nullptr`.
+    // This is a fast, lock-free operation.
+    // Thread-compatible, but not thread-safe.
+    //
+    // Reentrancy: Only the outermost call announces a new epoch and loads the
+    // current value. Nested calls return the same value.
+    //
+    // WARNING: Do not use `reset` or `release` on the returned `unique_ptr`.
+    // Doing so is likely to lead to undefined behavior.
+    Snapshot ReadPtr() noexcept {
+      if (snapshot_depth_ == 0) {
+        // The announcement must be globally visible before loading `current_`
+        // (and therefore sequentially consistent), so that `Reclaim` either
+        // observes it, or this thread observes the value replacing the one
+        // being reclaimed.
+        slot_->epoch.store(rcu_.epoch_.load(std::memory_order_seq_cst),
+                           std::memory_order_seq_cst);
+        snapshot_ = rcu_.current_.load(std::memory_order_seq_cst);
+        if (snapshot_ == nullptr) {
+          // A `nullptr` never invokes its deleter and there is no value to
+          // keep, so stop reading right away.
+          slot_->epoch.store(kQuiescent, std::memory_order_release);
+          return Snapshot(nullptr, SnapshotDeleter<>(*this));
+        }
+      }
+      snapshot_depth_++;
+      return Snapshot(snapshot_, SnapshotDeleter<>(*this));
+    }
+
+   private:
+    // Announced epoch of a single `View`, shared with the registry of its
+    // `EpochRcu`.
+    struct Slot {
+      Slot() : epoch(kQuiescent) {}
+
+      // The epoch in which the current outermost `Snapshot` was obtained, or
+      // `kQuiescent` if there is none.
+      std::atomic<uint_fast64_t> epoch;
+    };
+
+    void Release() noexcept {
+      if (--snapshot_depth_ == 0) {
+        slot_->epoch.store(kQuiescent, std::memory_order_release);
+      }
+    }
+
+    EpochRcu &rcu_;
+    // Incremented with each `Snapshot` instance. Ensures that only the
+    // outermost `Snapshot` announces an epoch.
+    int_fast16_t snapshot_depth_;
+    // The value returned by the outermost `Snapshot`.
+    const T *snapshot_;
+    const std::shared_ptr<Slot> slot_;
+
+    friend class EpochRcu;
+  };
+
+  // Constructs a RCU with an initial value `nullptr`.
+  EpochRcu() : EpochRcu(nullptr) {}
+  explicit EpochRcu(std::unique_ptr<const T> initial_value)
+      : epoch_(kQuiescent + 1),
+        current_(initial_value.release()),
+        lock_(),
+        retired_(),
+        registry_lock_(),
+        slots_() {}
+  EpochRcu(const EpochRcu &) = delete;
+  EpochRcu &operator=(const EpochRcu &) = delete;
+
+  ~EpochRcu() noexcept {
+    delete current_.load(std::memory_order_acquire);
+    for (const Retired &retired : retired_) {
+      delete retired.value;
+    }
+  }
+
+  // Atomically replaces the current value. The previous one is destroyed
+  // later, once no `View` can observe it any more.
+  // Afterwards reclaims values replaced earlier, like `Reclaim`.
+  //
+  // Thread-safe.
+  void Update(std::unique_ptr<const T> value) ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    const T *previous =
+        current_.exchange(value.release(), std::memory_order_seq_cst);
+    // `View`s that announce the new epoch are guaranteed to observe the new
+    // value.
+    const uint_fast64_t epoch =
+        epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+    if (previous != nullptr) {
+      retired_.push_back(Retired{previous, epoch});
+    }
+    ReclaimLocked();
+  }
+
+  // Destroys replaced values that can't be observed by any `View` any more.
+  // Returns the number of values that still await destruction.
+  //
+  // Thread-safe. Can be called for example periodically by a background
+  // thread to make destruction independent of `Update` calls.
+  size_t Reclaim() ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    return ReclaimLocked();
+  }
+
+ private:
+  using Slot = typename View::Slot;
+
+  static constexpr uint_fast64_t kQuiescent = 0;
+
+  // A replaced value that can be destroyed once all `View`s that announced an
+  // epoch less than `epoch` finish reading.
+  struct Retired {
+    const T *value;
+    uint_fast64_t epoch;
+  };
+
+  size_t ReclaimLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_)
+      ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    if (retired_.empty()) {
+      return 0;
+    }
+    const uint_fast64_t min_epoch = MinReadingEpoch();
+    // Values are retired with increasing epochs.
+    auto end = std::find_if(retired_.begin(), retired_.end(),
+                            [min_epoch](const Retired &retired) {
+                              return retired.epoch > min_epoch;
+                            });
+    for (auto it = retired_.begin(); it != end; ++it) {
+      delete it->value;
+    }
+    retired_.erase(retired_.begin(), end);
+    return retired_.size();
+  }
+
+  // Returns the minimum epoch announced by a reading `View`, or the maximum
+  // representable value if there is none.
+  uint_fast64_t MinReadingEpoch() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    uint_fast64_t min_epoch = std::numeric_limits<uint_fast64_t>::max();
+    absl::MutexLock registry(&registry_lock_);
+    for (size_t i = 0; i < slots_.size();) {
+      if (slots_[i].use_count() == 1) {
+        // Abandoned by its `View`.
+        slots_[i] = std::move(slots_.back());
+        slots_.pop_back();
+        continue;
+      }
+      const uint_fast64_t epoch =
+          slots_[i]->epoch.load(std::memory_order_seq_cst);
+      if (epoch != kQuiescent) {
+        min_epoch = std::min(min_epoch, epoch);
+      }
+      i++;
+    }
+    return min_epoch;
+  }
+
+  std::shared_ptr<Slot> Register() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    absl::MutexLock registry(&registry_lock_);
+    slots_.push_back(std::make_shared<Slot>());
+    return slots_.back();
+  }
+
+  // Incremented after each replacement of `current_`.
+  std::atomic<uint_fast64_t> epoch_;
+  std::atomic<const T *> current_;
+  // Serializes updates and reclamation.
+  absl::Mutex lock_;
+  // Replaced values waiting for destruction, ordered by their epochs.
+  std::vector<Retired> retired_ ABSL_GUARDED_BY(lock_);
+  absl::Mutex registry_lock_ ABSL_ACQUIRED_AFTER(lock_);
+  // Registered thread-`View` instances.
+  std::vector<std::shared_ptr<Slot>> slots_ ABSL_GUARDED_BY(registry_lock_);
+};
+
+template <typename T>
+constexpr uint_fast64_t EpochRcu<T>::kQuiescent;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_EPOCH_RCU_H
@@ -0,0 +1,128 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/epoch_rcu.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "absl/memory/memory.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::Pointee;
+
+// Counts live instances in `*live`.
+struct Counted {
+  Counted(int value_, std::atomic<int> *live_) : value(value_), live(live_) {
+    (*live)++;
+  }
+  ~Counted() { (*live)--; }
+
+  int value;
+  std::atomic<int> *live;
+};
+
+TEST(EpochRcuTest, UpdateAndReadPtr) {
+  EpochRcu<int> rcu;
+  EpochRcu<int>::View local1(rcu);
+  EXPECT_EQ(local1.ReadPtr(), nullptr);
+  rcu.Update(absl::make_unique<int>(42));
+  EpochRcu<int>::View local2(rcu);
+  EXPECT_THAT(local1.ReadPtr(), Pointee(42))
+      << "Thread registered prior Update must receive the value";
+  EXPECT_THAT(local2.ReadPtr(), Pointee(42))
+      << "Thread registered after Update must also receive the value";
+  EXPECT_EQ(local1.ReadPtr(), local2.ReadPtr())
+      << "Both snapshots must point to the single shared value";
+}
+
+TEST(EpochRcuTest, ReadRemainsStable) {
+  EpochRcu<int> rcu(absl::make_unique<int>(42));
+  EpochRcu<int>::View local(rcu);
+  auto read_ref1 = local.ReadPtr();
+  rcu.Update(absl::make_unique<int>(73));
+  EXPECT_THAT(read_ref1, Pointee(42))
+      << "The first reference must hold its value past Update()";
+  auto read_ref2 = local.ReadPtr();
+  EXPECT_EQ(read_ref1.get(), read_ref2.get())
+      << "A nested ReadPtr() must point to the same value as an outer one";
+}
+
+TEST(EpochRcuTest, ReclaimsOnlyUnobservableValues) {
+  std::atomic<int> live(0);
+  EpochRcu<Counted> rcu(absl::make_unique<Counted>(0, &live));
+  EpochRcu<Counted>::View local(rcu);
+  {
+    auto snapshot = local.ReadPtr();
+    rcu.Update(absl::make_unique<Counted>(1, &live));
+    rcu.Update(absl::make_unique<Counted>(2, &live));
+    EXPECT_EQ(live.load(), 3)
+        << "Values replaced while a View is reading must be kept";
+    EXPECT_EQ(snapshot->value, 0);
+    EXPECT_EQ(rcu.Reclaim(), 2);
+  }
+  EXPECT_EQ(rcu.Reclaim(), 0)
+      << "All replaced values must be destroyed once the View stops reading";
+  EXPECT_EQ(live.load(), 1);
+  EXPECT_EQ(local.ReadPtr()->value, 2);
+  rcu.Update(absl::make_unique<Counted>(3, &live));
+  EXPECT_EQ(live.load(), 1) << "A quiescent View must not delay destruction";
+}
+
+TEST(EpochRcuTest, DestroysAllValues) {
+  std::atomic<int> live(0);
+  {
+    EpochRcu<Counted> rcu(absl::make_unique<Counted>(0, &live));
+    EpochRcu<Counted>::View local(rcu);
+    auto snapshot = local.ReadPtr();
+    rcu.Update(absl::make_unique<Counted>(1, &live));
+  }
+  EXPECT_EQ(live.load(), 0);
+}
+
+TEST(EpochRcuTest, ConcurrentUpdatesAndReads) {
+  constexpr int kUpdates = 10000;
+  std::atomic<int> live(0);
+  EpochRcu<Counted> rcu(absl::make_unique<Counted>(0, &live));
+  std::atomic<bool> finished(false);
+  std::thread updater([&]() {
+    for (int i = 1; i <= kUpdates; i++) {
+      rcu.Update(absl::make_unique<Counted>(i, &live));
+    }
+    finished.store(true);
+  });
+  EpochRcu<Counted>::View local(rcu);
+  int previous = 0;
+  bool updater_finished;
+  do {
+    updater_finished = finished.load();
+    auto snapshot = local.ReadPtr();
+    const int current = snapshot->value;
+    ASSERT_GE(current, previous) << "Values must never go back";
+    ASSERT_EQ(snapshot->value, current) << "The snapshot must remain valid";
+    previous = current;
+  } while (!updater_finished);
+  EXPECT_EQ(previous, kUpdates) << "Must receive the last value";
+  updater.join();
+  EXPECT_EQ(rcu.Reclaim(), 0);
+  EXPECT_EQ(live.load(), 1);
+}
+
+}  // namespace
+}  // namespace simple_rcu
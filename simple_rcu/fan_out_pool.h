@@ -0,0 +1,160 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_FAN_OUT_POOL_H
+#define _SIMPLE_RCU_FAN_OUT_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+
+namespace simple_rcu {
+
+// A small pool of helper threads that run shards of a single task in
+// parallel, together with the calling thread.
+//
+// Intended mainly for distributing values to a large number of `View`
+// instances during `CopyRcu::Update`, see `CopyRcu::ShardedFanOut`.
+class FanOutPool {
+ public:
+  // Starts `helpers` threads, which are idle until `Run` is called.
+  explicit FanOutPool(int helpers)
+      : run_lock_(),
+        lock_(),
+        stopping_(false),
+        generation_(0),
+        task_(nullptr),
+        shards_(0),
+        finished_(0),
+        active_(0),
+        next_(0),
+        threads_() {
+    for (int i = 0; i < helpers; i++) {
+      threads_.emplace_back([this]() { Helper(); });
+    }
+  }
+  FanOutPool(const FanOutPool &) = delete;
+  FanOutPool &operator=(const FanOutPool &) = delete;
+
+  ~FanOutPool() ABSL_LOCKS_EXCLUDED(lock_) {
+    {
+      absl::MutexLock lock(&lock_);
+      stopping_ = true;
+    }
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // Runs `shard(i)` for every `i` in [0, `shards`) on the helper threads and
+  // the calling thread. Returns after all of them have finished.
+  //
+  // Thread-safe. Concurrent calls are serialized.
+  void Run(size_t shards, absl::FunctionRef<void(size_t)> shard)
+      ABSL_LOCKS_EXCLUDED(run_lock_, lock_) {
+    absl::MutexLock run(&run_lock_);
+    {
+      absl::MutexLock lock(&lock_);
+      task_ = &shard;
+      shards_ = shards;
+      finished_ = 0;
+      next_.store(0, std::memory_order_relaxed);
+      generation_++;
+    }
+    const size_t done = Work(shard, shards);
+    absl::MutexLock lock(&lock_);
+    finished_ += done;
+    // Waiting also for `active_` ensures no helper still holds `shard` or
+    // claims from `next_` once this call returns.
+    auto all_finished = [this]() {
+      return (finished_ == shards_) && (active_ == 0);
+    };
+    lock_.Await(absl::Condition(&all_finished));
+    task_ = nullptr;
+  }
+
+  // Returns a function that calls `Run` on this pool, suitable for
+  // `CopyRcu::ShardedFanOut::executor`. The pool must outlive it.
+  std::function<void(size_t, absl::FunctionRef<void(size_t)>)> Executor() {
+    return [this](size_t shards, absl::FunctionRef<void(size_t)> shard) {
+      Run(shards, shard);
+    };
+  }
+
+ private:
+  // Claims and runs shards until none remain. Returns the number of shards
+  // run.
+  size_t Work(absl::FunctionRef<void(size_t)> shard, size_t shards) {
+    size_t done = 0;
+    for (size_t i = next_.fetch_add(1, std::memory_order_relaxed); i < shards;
+         i = next_.fetch_add(1, std::memory_order_relaxed)) {
+      shard(i);
+      done++;
+    }
+    return done;
+  }
+
+  void Helper() ABSL_LOCKS_EXCLUDED(lock_) {
+    uint_fast64_t seen_generation = 0;
+    absl::MutexLock lock(&lock_);
+    while (true) {
+      auto has_work = [this, &seen_generation]() {
+        return stopping_ ||
+               ((task_ != nullptr) && (generation_ != seen_generation));
+      };
+      lock_.Await(absl::Condition(&has_work));
+      if (stopping_) {
+        return;
+      }
+      seen_generation = generation_;
+      const absl::FunctionRef<void(size_t)> shard = *task_;
+      const size_t shards = shards_;
+      active_++;
+      lock_.Unlock();
+      const size_t done = Work(shard, shards);
+      lock_.Lock();
+      active_--;
+      finished_ += done;
+    }
+  }
+
+  // Serializes concurrent calls to `Run`.
+  absl::Mutex run_lock_ ABSL_ACQUIRED_BEFORE(lock_);
+  absl::Mutex lock_;
+  bool stopping_ ABSL_GUARDED_BY(lock_);
+  // Incremented by each `Run`, so that each helper joins each task at most
+  // once.
+  uint_fast64_t generation_ ABSL_GUARDED_BY(lock_);
+  // The task being run, or `nullptr` if there is none.
+  const absl::FunctionRef<void(size_t)> *task_ ABSL_GUARDED_BY(lock_);
+  size_t shards_ ABSL_GUARDED_BY(lock_);
+  // Number of shards of the current task that have finished.
+  size_t finished_ ABSL_GUARDED_BY(lock_);
+  // Number of helpers currently working on the task.
+  int active_ ABSL_GUARDED_BY(lock_);
+  // The next shard to be claimed.
+  std::atomic<size_t> next_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_FAN_OUT_POOL_H
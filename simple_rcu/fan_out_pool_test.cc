@@ -0,0 +1,69 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/fan_out_pool.h"
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(FanOutPoolTest, RunsEachShardExactlyOnce) {
+  FanOutPool pool(3);
+  for (size_t shards : {0, 1, 2, 7, 100}) {
+    SCOPED_TRACE(shards);
+    std::vector<int> counts(shards, 0);
+    pool.Run(shards, [&counts](size_t i) { counts[i]++; });
+    for (size_t i = 0; i < shards; i++) {
+      EXPECT_EQ(counts[i], 1) << "Shard " << i;
+    }
+  }
+}
+
+TEST(FanOutPoolTest, WithoutHelpers) {
+  FanOutPool pool(0);
+  int count = 0;
+  pool.Run(10, [&count](size_t) { count++; });
+  EXPECT_EQ(count, 10) << "The calling thread must run all shards";
+}
+
+TEST(FanOutPoolTest, ConcurrentRuns) {
+  FanOutPool pool(2);
+  auto executor = pool.Executor();
+  std::vector<std::thread> threads;
+  std::vector<std::vector<int>> counts(4, std::vector<int>(50, 0));
+  for (auto &thread_counts : counts) {
+    threads.emplace_back([&executor, &thread_counts]() {
+      for (int j = 0; j < 100; j++) {
+        executor(thread_counts.size(),
+                 [&thread_counts](size_t i) { thread_counts[i]++; });
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (const auto &thread_counts : counts) {
+    for (int count : thread_counts) {
+      EXPECT_EQ(count, 100);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace simple_rcu
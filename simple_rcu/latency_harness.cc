@@ -0,0 +1,456 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures tail latencies of RCU operations under a mixed workload of reader
+// and updater threads, and prints them as JSON suitable for tracking
+// regressions.
+//
+// Unlike the Google Benchmark based `*_benchmark` targets, which report mean
+// time per iteration, every single operation is timed and recorded in a
+// `LatencyHistogram`. For each backend it reports:
+//
+// - `CopyRcu<T>` (`copy_rcu`) and `Rcu<T>` (`rcu`): latencies of `Read()` by
+//   `--readers` threads, of `Update()` by `--updaters` threads, and the time
+//   from the start of an `Update()` until a reader observes its value.
+// - `ReverseRcu<T>` (`reverse_rcu`): latencies of `Write()` by `--readers`
+//   threads, of `Collect()` by `--updaters` threads, and the age of the oldest
+//   value written before each `Collect()`.
+//
+// Example:
+//
+//   latency_harness --readers=8 --value_bytes=1024 --output=latencies.json
+//
+// Reported latencies include the overhead of reading the clock, which is
+// reported separately as `clock_overhead_ns`.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/copy_rcu.h"
+#include "simple_rcu/latency_histogram.h"
+#include "simple_rcu/reverse_rcu.h"
+
+ABSL_FLAG(std::vector<std::string>, backends,
+          std::vector<std::string>({"copy_rcu", "rcu", "reverse_rcu"}),
+          "Comma-separated RCU implementations to measure: copy_rcu, rcu or "
+          "reverse_rcu.");
+ABSL_FLAG(int, readers, 4,
+          "Number of threads calling Read() (Write() for reverse_rcu).");
+ABSL_FLAG(int, updaters, 1,
+          "Number of threads calling Update() (Collect() for reverse_rcu).");
+ABSL_FLAG(int, update_interval_us, 100,
+          "Pause of each updater thread between two operations. If 0, "
+          "updaters run back-to-back.");
+ABSL_FLAG(int, duration_ms, 1000, "Duration of the measurement per backend.");
+ABSL_FLAG(int, value_bytes, 64,
+          "Size of the RCU value type: 8, 64, 256, 1024 or 4096.");
+ABSL_FLAG(bool, pin, true,
+          "Pin each thread to a separate CPU (modulo the number of CPUs). "
+          "Only supported on Linux.");
+ABSL_FLAG(std::string, output, "",
+          "File to write the JSON results to. If empty, writes to stdout.");
+
+namespace simple_rcu {
+namespace {
+
+int64_t NowNanos() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The smallest observed difference between two consecutive `NowNanos()`.
+int64_t ClockOverheadNanos() {
+  int64_t overhead = std::numeric_limits<int64_t>::max();
+  for (int i = 0; i < 10000; i++) {
+    const int64_t start = NowNanos();
+    overhead = std::min(overhead, NowNanos() - start);
+  }
+  return overhead;
+}
+
+unsigned Cpus() { return std::max(std::thread::hardware_concurrency(), 1u); }
+
+// Pins the calling thread to CPU `index` modulo the number of CPUs.
+void PinCurrentThread(int index) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(index % Cpus(), &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    std::cerr << "Failed to pin a thread to CPU " << index % Cpus()
+              << std::endl;
+  }
+#else
+  (void)index;
+#endif
+}
+
+// An RCU value of exactly `kBytes` bytes.
+template <size_t kBytes>
+struct Payload {
+  static_assert(kBytes % sizeof(uint64_t) == 0 && kBytes > 0,
+                "kBytes must be a positive multiple of 8");
+
+  Payload() : timestamp(0), padding() {}
+
+  // Used by `ReverseRcu<Payload>::Collect`. Keeps the oldest timestamp.
+  Payload& operator+=(Payload&& other) {
+    if (timestamp == 0 ||
+        (other.timestamp != 0 && other.timestamp < timestamp)) {
+      timestamp = other.timestamp;
+    }
+    for (size_t i = 0; i < padding.size(); i++) {
+      padding[i] += other.padding[i];
+    }
+    return *this;
+  }
+
+  // `NowNanos()` when the value was created, or 0 for the initial value.
+  int64_t timestamp;
+  std::array<uint64_t, kBytes / sizeof(uint64_t) - 1> padding;
+};
+
+// Indices of the histograms recorded by each thread.
+enum Latency { kRead = 0, kUpdate, kVisibility, kLatencies };
+
+using Histograms = std::array<LatencyHistogram, kLatencies>;
+
+// A backend for `CopyRcu<P>` (if `kShared` is false) or `Rcu<P>`.
+template <typename P, bool kShared>
+class CopyRcuBackend {
+ public:
+  using RcuType =
+      CopyRcu<typename std::conditional<kShared, std::shared_ptr<const P>,
+                                        P>::type>;
+
+  static std::array<const char*, kLatencies> Names() {
+    return {{"read", "update", "update_to_visibility"}};
+  }
+
+  class Reader {
+   public:
+    explicit Reader(CopyRcuBackend& backend)
+        : view_(backend.rcu_), last_timestamp_(0) {}
+
+    void Run(Histograms& histograms) noexcept {
+      const int64_t start = NowNanos();
+      int64_t timestamp;
+      {
+        auto snapshot = view_.Read();
+        timestamp = Get(*snapshot).timestamp;
+      }
+      const int64_t end = NowNanos();
+      histograms[kRead].Record(end - start);
+      if (timestamp != last_timestamp_) {
+        histograms[kVisibility].Record(end - timestamp);
+        last_timestamp_ = timestamp;
+      }
+    }
+
+   private:
+    static const P& Get(const P& value) { return value; }
+    static const P& Get(const std::shared_ptr<const P>& value) {
+      return *value;
+    }
+
+    typename RcuType::View view_;
+    int64_t last_timestamp_;
+  };
+
+  CopyRcuBackend() : rcu_(New(0, Shared())) {}
+
+  void Update(Histograms& histograms) {
+    const int64_t start = NowNanos();
+    // Includes destroying the previous value, which is returned as a
+    // temporary destroyed at the end of the statement.
+    rcu_.Update(New(start, Shared()));
+    histograms[kUpdate].Record(NowNanos() - start);
+  }
+
+ private:
+  using Shared = std::integral_constant<bool, kShared>;
+
+  static P New(int64_t timestamp, std::false_type) {
+    P value;
+    value.timestamp = timestamp;
+    return value;
+  }
+  static std::shared_ptr<const P> New(int64_t timestamp, std::true_type) {
+    auto value = std::make_shared<P>();
+    value->timestamp = timestamp;
+    return value;
+  }
+
+  RcuType rcu_;
+};
+
+template <typename P>
+class ReverseRcuBackend {
+ public:
+  static std::array<const char*, kLatencies> Names() {
+    return {{"write", "collect", "write_to_collect"}};
+  }
+
+  class Reader {
+   public:
+    explicit Reader(ReverseRcuBackend& backend) : view_(backend.rcu_) {}
+
+    // Each write touches the whole value, like updating a metric of that
+    // size.
+    void Run(Histograms& histograms) noexcept {
+      const int64_t start = NowNanos();
+      {
+        auto snapshot = view_.Write();
+        if (snapshot->timestamp == 0) {
+          snapshot->timestamp = start;
+        }
+        for (uint64_t& word : snapshot->padding) {
+          word++;
+        }
+      }
+      histograms[kRead].Record(NowNanos() - start);
+    }
+
+   private:
+    typename ReverseRcu<P>::View view_;
+  };
+
+  void Update(Histograms& histograms) {
+    const int64_t start = NowNanos();
+    const P collected = rcu_.Collect();
+    const int64_t end = NowNanos();
+    histograms[kUpdate].Record(end - start);
+    if (collected.timestamp != 0) {
+      histograms[kVisibility].Record(end - collected.timestamp);
+    }
+  }
+
+ private:
+  ReverseRcu<P> rcu_;
+};
+
+struct Config {
+  int readers;
+  int updaters;
+  int update_interval_us;
+  int duration_ms;
+  int value_bytes;
+  bool pin;
+};
+
+struct Result {
+  std::string backend;
+  std::array<const char*, kLatencies> names;
+  Histograms histograms;
+  double seconds;
+};
+
+// Runs the workload described by `config` on a new instance of `B`.
+template <typename B>
+std::unique_ptr<Result> Run(const std::string& name, const Config& config) {
+  B backend;
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+  absl::BlockingCounter ready(config.readers + config.updaters);
+  absl::Mutex lock;
+  auto result = absl::make_unique<Result>();
+  result->backend = name;
+  result->names = B::Names();
+  // Merges histograms of a finished thread into `result`.
+  auto merge = [&lock, &result](const Histograms& histograms) {
+    absl::MutexLock mutex(&lock);
+    for (size_t i = 0; i < histograms.size(); i++) {
+      result->histograms[i] += histograms[i];
+    }
+  };
+
+  std::vector<std::thread> threads;
+  int cpu = 0;
+  for (int i = 0; i < config.updaters; i++, cpu++) {
+    threads.emplace_back([&, cpu]() {
+      if (config.pin) {
+        PinCurrentThread(cpu);
+      }
+      auto histograms = absl::make_unique<Histograms>();
+      ready.DecrementCount();
+      while (!start.load()) {
+        std::this_thread::yield();
+      }
+      while (!stop.load(std::memory_order_relaxed)) {
+        backend.Update(*histograms);
+        if (config.update_interval_us > 0) {
+          std::this_thread::sleep_for(
+              std::chrono::microseconds(config.update_interval_us));
+        }
+      }
+      merge(*histograms);
+    });
+  }
+  for (int i = 0; i < config.readers; i++, cpu++) {
+    threads.emplace_back([&, cpu]() {
+      if (config.pin) {
+        PinCurrentThread(cpu);
+      }
+      auto histograms = absl::make_unique<Histograms>();
+      // Registration isn't measured.
+      typename B::Reader reader(backend);
+      ready.DecrementCount();
+      while (!start.load()) {
+        std::this_thread::yield();
+      }
+      while (!stop.load(std::memory_order_relaxed)) {
+        reader.Run(*histograms);
+      }
+      merge(*histograms);
+    });
+  }
+  ready.Wait();
+  const int64_t begin = NowNanos();
+  start.store(true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+  stop.store(true);
+  const int64_t end = NowNanos();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  result->seconds = (end - begin) / 1e9;
+  return result;
+}
+
+template <size_t kBytes>
+std::unique_ptr<Result> RunBackend(const std::string& name,
+                                   const Config& config) {
+  using P = Payload<kBytes>;
+  if (name == "copy_rcu") {
+    return Run<CopyRcuBackend<P, false>>(name, config);
+  } else if (name == "rcu") {
+    return Run<CopyRcuBackend<P, true>>(name, config);
+  } else if (name == "reverse_rcu") {
+    return Run<ReverseRcuBackend<P>>(name, config);
+  }
+  return nullptr;
+}
+
+std::unique_ptr<Result> RunBackend(const std::string& name,
+                                   const Config& config) {
+  switch (config.value_bytes) {
+    case 8:
+      return RunBackend<8>(name, config);
+    case 64:
+      return RunBackend<64>(name, config);
+    case 256:
+      return RunBackend<256>(name, config);
+    case 1024:
+      return RunBackend<1024>(name, config);
+    case 4096:
+      return RunBackend<4096>(name, config);
+  }
+  return nullptr;
+}
+
+void WriteJson(std::ostream& out, const Config& config,
+               const std::vector<std::unique_ptr<Result>>& results) {
+  out << "{\n"
+      << "  \"config\": {\n"
+      << "    \"readers\": " << config.readers << ",\n"
+      << "    \"updaters\": " << config.updaters << ",\n"
+      << "    \"update_interval_us\": " << config.update_interval_us << ",\n"
+      << "    \"duration_ms\": " << config.duration_ms << ",\n"
+      << "    \"value_bytes\": " << config.value_bytes << ",\n"
+      << "    \"pin\": " << (config.pin ? "true" : "false") << ",\n"
+      << "    \"cpus\": " << Cpus() << ",\n"
+      << "    \"clock_overhead_ns\": " << ClockOverheadNanos() << "\n"
+      << "  },\n"
+      << "  \"results\": [";
+  for (size_t r = 0; r < results.size(); r++) {
+    const Result& result = *results[r];
+    out << (r == 0 ? "\n" : ",\n") << "    {\n"
+        << "      \"backend\": \"" << result.backend << "\",\n"
+        << "      \"seconds\": " << result.seconds << ",\n"
+        << "      \"latencies_ns\": {";
+    for (size_t i = 0; i < result.histograms.size(); i++) {
+      const LatencyHistogram& histogram = result.histograms[i];
+      out << (i == 0 ? "\n" : ",\n") << "        \"" << result.names[i]
+          << "\": {"
+          << "\"count\": " << histogram.count()
+          << ", \"ops_per_second\": " << histogram.count() / result.seconds
+          << ", \"mean\": " << histogram.Mean()
+          << ", \"min\": " << histogram.min()
+          << ", \"p50\": " << histogram.Percentile(50)
+          << ", \"p90\": " << histogram.Percentile(90)
+          << ", \"p99\": " << histogram.Percentile(99)
+          << ", \"p99.9\": " << histogram.Percentile(99.9)
+          << ", \"max\": " << histogram.max() << "}";
+    }
+    out << "\n      }\n    }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+}  // namespace
+}  // namespace simple_rcu
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  const simple_rcu::Config config{absl::GetFlag(FLAGS_readers),
+                                  absl::GetFlag(FLAGS_updaters),
+                                  absl::GetFlag(FLAGS_update_interval_us),
+                                  absl::GetFlag(FLAGS_duration_ms),
+                                  absl::GetFlag(FLAGS_value_bytes),
+                                  absl::GetFlag(FLAGS_pin)};
+  std::vector<std::unique_ptr<simple_rcu::Result>> results;
+  for (const std::string& backend : absl::GetFlag(FLAGS_backends)) {
+    results.push_back(simple_rcu::RunBackend(backend, config));
+    if (results.back() == nullptr) {
+      std::cerr << "Unknown --backends=" << backend << " or unsupported "
+                << "--value_bytes=" << config.value_bytes << std::endl;
+      return 1;
+    }
+  }
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (output.empty()) {
+    simple_rcu::WriteJson(std::cout, config, results);
+  } else {
+    std::ofstream file(output);
+    simple_rcu::WriteJson(file, config, results);
+    if (!file) {
+      std::cerr << "Failed to write " << output << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_LATENCY_HISTOGRAM_H
+#define _SIMPLE_RCU_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "absl/numeric/bits.h"
+
+namespace simple_rcu {
+
+// Histogram of non-negative integer samples (typically latencies in
+// nanoseconds) with log-linear buckets, similar to HdrHistogram.
+//
+// Values below `kSubBuckets` have a bucket each. Every larger power-of-two
+// range is split into `kSubBuckets` equal buckets, so the relative error of
+// `Percentile` is at most `1 / kSubBuckets` over the whole 64-bit range, in a
+// fixed amount of memory.
+//
+// `Record` is a few arithmetic instructions with no allocation, so it's
+// suitable for recording every operation of a latency-sensitive thread.
+// Thread-compatible. Threads are expected to record into their own instances
+// and merge them afterwards with `operator+=`.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  LatencyHistogram()
+      : buckets_(),
+        count_(0),
+        sum_(0),
+        min_(std::numeric_limits<uint64_t>::max()),
+        max_(0) {}
+
+  void Record(uint64_t value) noexcept {
+    buckets_[BucketIndex(value)]++;
+    count_++;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  LatencyHistogram& operator+=(const LatencyHistogram& other) noexcept {
+    for (size_t i = 0; i < kBuckets; i++) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    return *this;
+  }
+
+  // Returns an upper bound of the smallest value such that at least
+  // `percentile`% of recorded values are less than or equal to it.
+  // The result is exact for values below `kSubBuckets`, never exceeds `max()`
+  // and is otherwise within the relative error of the bucket. Returns 0 if
+  // nothing has been recorded.
+  uint64_t Percentile(double percentile) const noexcept {
+    if (count_ == 0) {
+      return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+      seen += buckets_[i];
+      if (seen >= rank) {
+        return std::min(BucketUpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  uint64_t count() const noexcept { return count_; }
+  // Returns 0 if nothing has been recorded.
+  uint64_t min() const noexcept { return count_ == 0 ? 0 : min_; }
+  uint64_t max() const noexcept { return max_; }
+  double Mean() const noexcept {
+    return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;
+  }
+
+  // Exposed for testing.
+  static size_t BucketIndex(uint64_t value) noexcept {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    // The number of low bits dropped to keep the `kSubBucketBits + 1` most
+    // significant ones, whose highest bit is always set.
+    const int shift = absl::bit_width(value) - kSubBucketBits - 1;
+    return kSubBuckets + shift * kSubBuckets +
+           ((value >> shift) - kSubBuckets);
+  }
+
+  // The largest value that falls into bucket `index`.
+  static uint64_t BucketUpperBound(size_t index) noexcept {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    const size_t shift = (index - kSubBuckets) / kSubBuckets;
+    const uint64_t top = kSubBuckets + (index - kSubBuckets) % kSubBuckets;
+    return ((top + 1) << shift) - 1;
+  }
+
+ private:
+  std::array<uint64_t, kBuckets> buckets_;
+  uint64_t count_;
+  // Wraps around only after recording ~584 years worth of nanoseconds.
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_LATENCY_HISTOGRAM_H
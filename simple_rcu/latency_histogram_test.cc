@@ -0,0 +1,99 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/latency_histogram.h"
+
+#include <cstdint>
+#include <limits>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(LatencyHistogramTest, EmptyHistogram) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.count(), 0u);
+  EXPECT_EQ(histogram.min(), 0u);
+  EXPECT_EQ(histogram.max(), 0u);
+  EXPECT_EQ(histogram.Mean(), 0.0);
+  EXPECT_EQ(histogram.Percentile(99), 0u);
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+  LatencyHistogram histogram;
+  for (uint64_t i = 1; i <= 10; i++) {
+    histogram.Record(i);
+  }
+  EXPECT_EQ(histogram.count(), 10u);
+  EXPECT_EQ(histogram.min(), 1u);
+  EXPECT_EQ(histogram.max(), 10u);
+  EXPECT_EQ(histogram.Mean(), 5.5);
+  EXPECT_EQ(histogram.Percentile(50), 5u);
+  EXPECT_EQ(histogram.Percentile(90), 9u);
+  EXPECT_EQ(histogram.Percentile(100), 10u);
+  EXPECT_EQ(histogram.Percentile(0), 1u);
+}
+
+TEST(LatencyHistogramTest, BucketsCoverAllValues) {
+  size_t previous = 0;
+  for (uint64_t value = 1; value < (1u << 20); value++) {
+    const size_t index = LatencyHistogram::BucketIndex(value);
+    ASSERT_GE(index, previous) << "Buckets must be monotonic at " << value;
+    ASSERT_LE(value, LatencyHistogram::BucketUpperBound(index));
+    if (index > 0) {
+      ASSERT_GT(value, LatencyHistogram::BucketUpperBound(index - 1));
+    }
+    previous = index;
+  }
+  const uint64_t max = std::numeric_limits<uint64_t>::max();
+  EXPECT_EQ(LatencyHistogram::BucketIndex(max),
+            LatencyHistogram::kBuckets - 1);
+  EXPECT_EQ(LatencyHistogram::BucketUpperBound(LatencyHistogram::kBuckets - 1),
+            max);
+}
+
+TEST(LatencyHistogramTest, PercentileWithinRelativeError) {
+  LatencyHistogram histogram;
+  for (uint64_t i = 1; i <= 100000; i++) {
+    histogram.Record(i);
+  }
+  for (double percentile : {50.0, 90.0, 99.0, 99.9}) {
+    SCOPED_TRACE(percentile);
+    const double expected = percentile * 1000;
+    const double actual = histogram.Percentile(percentile);
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected * (1.0 + 1.0 / LatencyHistogram::kSubBuckets));
+  }
+  EXPECT_EQ(histogram.Percentile(100), 100000u);
+}
+
+TEST(LatencyHistogramTest, Merge) {
+  LatencyHistogram first;
+  LatencyHistogram second;
+  first.Record(3);
+  second.Record(1);
+  second.Record(1000);
+  LatencyHistogram empty;
+  first += empty;
+  first += second;
+  EXPECT_EQ(first.count(), 3u);
+  EXPECT_EQ(first.min(), 1u);
+  EXPECT_EQ(first.max(), 1000u);
+  EXPECT_EQ(first.Percentile(50), 3u);
+  EXPECT_EQ(first.Percentile(100), 1000u);
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,212 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_LAZY_COPY_RCU_H
+#define _SIMPLE_RCU_LAZY_COPY_RCU_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/optimization.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+
+// Variant of `CopyRcu` where readers pull a new value on demand, instead of
+// `Update` pushing a copy to every `View`.
+//
+// `Update` only stores the new value and increments a generation counter, so
+// its cost doesn't depend on the number of `View` instances. A `View` copies
+// the value when `Read()` observes a new generation. Therefore readers that
+// don't call `Read()` between updates cost nothing, which is suitable for
+// large values of `T` with many mostly idle readers.
+//
+// In exchange, the first `Read()` after an update copies `T` on the reader
+// thread (holding a shared lock), and `Update` waits for readers that are
+// copying the previous value. That `Read()` also destroys the `View`'s copy of
+// the previous value on the reader thread, which for example frees it if it's
+// the last reference to it (a `std::shared_ptr`). So readers of values that
+// are expensive to destroy should prefer `CopyRcu`.
+//
+// `T` must be copyable.
+template <typename T>
+class LazyCopyRcu {
+ public:
+  using MutableT = typename std::remove_const<T>::type;
+  class View;
+
+  static_assert(std::is_copy_constructible<MutableT>::value &&
+                    std::is_copy_assignable<MutableT>::value,
+                "T must be copy constructible and assignable");
+
+  template <typename U = T>
+  class SnapshotDeleter {
+   public:
+    SnapshotDeleter(const SnapshotDeleter &) noexcept = default;
+    SnapshotDeleter &operator=(const SnapshotDeleter &) noexcept = default;
+
+    void operator()(U *) { registrar_.snapshot_depth_--; }
+
+   private:
+    SnapshotDeleter(View &registrar) noexcept : registrar_(registrar) {}
+
+    View &registrar_;
+
+    friend class View;
+  };
+
+  // Holds a read reference to a RCU value for the current thread.
+  // The reference is guaranteed to be stable during the lifetime of `Snapshot`.
+  // Callers are expected to limit the lifetime of `Snapshot` to as short as
+  // possible.
+  // WARNING: Bad things will happen if you use `reset` on a `Snapshot`.
+  // Thread-compatible (but not thread-safe), reentrant.
+  using Snapshot = std::unique_ptr<T, SnapshotDeleter<>>;
+
+  // Interface to the RCU local to a particular reader thread.
+  // Construction and destruction are thread-safe operations, but the `Read()`
+  // (and `ReadPtr()`) methods are only thread-compatible. Callers are expected
+  // to construct a separate `View` instance for each reader thread.
+  class View final {
+   public:
+    // Thread-safe. Argument `rcu` must outlive this instance.
+    // Copies the current value, therefore it may wait for a concurrent
+    // `Update`.
+    explicit View(LazyCopyRcu &rcu)
+        : rcu_(rcu), snapshot_depth_(0), generation_(), value_() {
+      absl::ReaderMutexLock lock(&rcu_.lock_);
+      generation_ = rcu_.generation_.load(std::memory_order_relaxed);
+      value_.emplace(rcu_.value_);
+    }
+
+    // Obtains a read snapshot to the current value held by the RCU.
+    // Never returns `nullptr`.
+    // Thread-compatible, but not thread-safe.
+    //
+    // Unless there has been an `Update` since the last time this `View`
+    // obtained a value, this is a very fast, lock-free operation consisting of
+    // a single atomic load. Otherwise it copies the new value.
+    //
+    // Reentrancy: Each call to `Read()` increments an internal reference
+    // counter, which is decremented by releasing a `Snapshot`. Only when the
+    // counter is being incremented from 0 a fresh value is obtained from the
+    // RCU. Subsequent nested calls to `Read()` return the same value. This
+    // mechanism ensures that the value of a `Snapshot` is not changed by such
+    // nested calls.
+    //
+    // WARNING: Do not use `reset` or `release` on the returned `unique_ptr`.
+    // Doing so is likely to lead to undefined behavior.
+    Snapshot Read() noexcept {
+      if (snapshot_depth_++ == 0) {
+        const uint_fast64_t generation =
+            rcu_.generation_.load(std::memory_order_acquire);
+        if (ABSL_PREDICT_FALSE(generation != generation_)) {
+          Pull();
+        }
+      }
+      return Snapshot(&*value_, SnapshotDeleter<>(*this));
+    }
+
+    // In case `T` is a `std::shared_ptr`, `ReadPtr` provides convenient access
+    // directly to the pointer's target.
+    template <typename U = T>
+    std::unique_ptr<typename U::element_type,
+                    SnapshotDeleter<typename U::element_type>>
+    ReadPtr() noexcept {
+      Snapshot snapshot = Read();
+      if (*snapshot == nullptr) {
+        return {nullptr, SnapshotDeleter<typename U::element_type>(*this)};
+      } else {
+        return {snapshot.release()->get(),
+                SnapshotDeleter<typename U::element_type>(*this)};
+      }
+    }
+
+   private:
+    // Copies the current value.
+    ABSL_ATTRIBUTE_NOINLINE void Pull() ABSL_LOCKS_EXCLUDED(rcu_.lock_) {
+      absl::ReaderMutexLock lock(&rcu_.lock_);
+      generation_ = rcu_.generation_.load(std::memory_order_relaxed);
+      // `T` can be `const`, therefore re-construct instead of assigning.
+      value_.emplace(rcu_.value_);
+    }
+
+    LazyCopyRcu &rcu_;
+    // Incremented with each `Snapshot` instance. Ensures that the value is
+    // pulled only for the outermost `Snapshot`, keeping its value unchanged
+    // for its whole lifetime.
+    int_fast16_t snapshot_depth_;
+    // The generation of `value_`.
+    uint_fast64_t generation_;
+    // Always holds a value after construction.
+    absl::optional<T> value_;
+
+    friend class LazyCopyRcu;
+  };
+
+  // Constructs a RCU with an initial value `T()`.
+  LazyCopyRcu() : LazyCopyRcu(T()) {}
+  explicit LazyCopyRcu(T initial_value)
+      : generation_(0), lock_(), value_(std::move(initial_value)) {}
+  LazyCopyRcu(const LazyCopyRcu &) = delete;
+  LazyCopyRcu &operator=(const LazyCopyRcu &) = delete;
+
+  // Replaces the value, which `View` instances will pick up on their next
+  // `Read()`. Returns the previous value.
+  //
+  // Doesn't copy `value`. Waits only for `View`s that are copying the
+  // previous value at the moment.
+  //
+  // Thread-safe.
+  T Update(MutableT value) ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    return UpdateLocked(std::move(value));
+  }
+  // Similar to `Update`, but replaces the value only if the old one satisfies
+  // the given predicate.
+  absl::optional<T> UpdateIf(MutableT value,
+                             absl::FunctionRef<bool(const T &)> pred)
+      ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    if (pred(value_)) {
+      return absl::make_optional(UpdateLocked(std::move(value)));
+    } else {
+      return absl::nullopt;
+    }
+  }
+
+ private:
+  T UpdateLocked(MutableT value) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    std::swap(value_, value);
+    generation_.fetch_add(1, std::memory_order_release);
+    return value;
+  }
+
+  // Incremented by each update. Polled by `View::Read()`, so it's kept on a
+  // separate cache line from `lock_`, which changes also when readers pull.
+  alignas(kCacheLineSize) std::atomic<uint_fast64_t> generation_;
+  alignas(kCacheLineSize) absl::Mutex lock_;
+  MutableT value_ ABSL_GUARDED_BY(lock_);
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_LAZY_COPY_RCU_H
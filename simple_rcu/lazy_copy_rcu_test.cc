@@ -0,0 +1,131 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/lazy_copy_rcu.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::Pointee;
+
+TEST(LazyCopyRcuTest, UpdateAndRead) {
+  LazyCopyRcu<int> rcu;
+  LazyCopyRcu<int>::View local1(rcu);
+  EXPECT_EQ(rcu.Update(42), 0);
+  LazyCopyRcu<int>::View local2(rcu);
+  EXPECT_THAT(local1.Read(), Pointee(42))
+      << "Thread registered prior Update must receive the value";
+  EXPECT_THAT(local2.Read(), Pointee(42))
+      << "Thread registered after Update must also receive the value";
+  EXPECT_NE(local1.Read(), local2.Read())
+      << "Each snapshot must be a different (local) pointer";
+}
+
+TEST(LazyCopyRcuTest, UpdateAndReadConstRef) {
+  const int old_value = 0;
+  LazyCopyRcu<const std::reference_wrapper<const int>> rcu(old_value);
+  LazyCopyRcu<const std::reference_wrapper<const int>>::View local(rcu);
+  const int value = 42;
+  rcu.Update(value);
+  EXPECT_THAT(local.Read(), Pointee(42))
+      << "Reader thread must receive a correct value";
+}
+
+TEST(LazyCopyRcuTest, UpdateIf) {
+  LazyCopyRcu<int> rcu(0);
+  LazyCopyRcu<int>::View local(rcu);
+  EXPECT_EQ(rcu.UpdateIf(42, [](int previous) { return previous != 0; }),
+            absl::nullopt);
+  EXPECT_THAT(local.Read(), Pointee(0))
+      << "Must not update a value that doesn't match the predicate";
+  EXPECT_EQ(rcu.UpdateIf(42, [](int previous) { return previous == 0; }), 0);
+  EXPECT_THAT(local.Read(), Pointee(42))
+      << "Must update a value that matches the predicate";
+}
+
+TEST(LazyCopyRcuTest, ReadRemainsStable) {
+  LazyCopyRcu<int> rcu(42);
+  LazyCopyRcu<int>::View local(rcu);
+  auto read_ref1 = local.Read();
+  rcu.Update(73);
+  EXPECT_THAT(read_ref1, Pointee(42))
+      << "The first reference must hold its value past Update()";
+  auto read_ref2 = local.Read();
+  EXPECT_THAT(read_ref2, Pointee(42))
+      << "A nested Read() must hold the same value as an outer one";
+  EXPECT_EQ(read_ref1.get(), read_ref2.get());
+}
+
+TEST(LazyCopyRcuTest, IdleReaderPullsOnlyTheLatestValue) {
+  int copies = 0;
+  struct Counted {
+    explicit Counted(int *copies_) : copies(copies_), value(0) {}
+    Counted(const Counted &other) : copies(other.copies), value(other.value) {
+      (*copies)++;
+    }
+    Counted(Counted &&) = default;
+    Counted &operator=(const Counted &other) = default;
+    Counted &operator=(Counted &&) = default;
+
+    int *copies;
+    int value;
+  };
+  LazyCopyRcu<Counted> rcu((Counted(&copies)));
+  LazyCopyRcu<Counted>::View local(rcu);
+  copies = 0;
+  for (int i = 1; i <= 10; i++) {
+    Counted value(&copies);
+    value.value = i;
+    rcu.Update(std::move(value));
+  }
+  EXPECT_EQ(copies, 0) << "Update must not copy the value to readers";
+  EXPECT_EQ(local.Read()->value, 10);
+  EXPECT_EQ(copies, 1) << "The reader must copy just the latest value";
+  EXPECT_EQ(local.Read()->value, 10);
+  EXPECT_EQ(copies, 1) << "An unchanged value must not be copied again";
+}
+
+TEST(LazyCopyRcuTest, ConcurrentUpdatesAndReads) {
+  constexpr int kUpdates = 10000;
+  LazyCopyRcu<std::shared_ptr<const int>> rcu(std::make_shared<const int>(0));
+  std::atomic<bool> finished(false);
+  std::thread updater([&]() {
+    for (int i = 1; i <= kUpdates; i++) {
+      rcu.Update(std::make_shared<const int>(i));
+    }
+    finished.store(true);
+  });
+  LazyCopyRcu<std::shared_ptr<const int>>::View local(rcu);
+  int previous = 0;
+  bool updater_finished;
+  do {
+    updater_finished = finished.load();
+    const int current = *local.ReadPtr();
+    ASSERT_GE(current, previous) << "Values must never go back";
+    previous = current;
+  } while (!updater_finished);
+  EXPECT_EQ(previous, kUpdates) << "Must receive the last value";
+  updater.join();
+}
+
+}  // namespace
+}  // namespace simple_rcu
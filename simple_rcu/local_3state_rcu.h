@@ -18,9 +18,48 @@
 #include <array>
 #include <atomic>
 #include <cstddef>
+#include <new>
+#include <utility>
 
 namespace simple_rcu {
 
+// Size of the unit of memory that two threads can't write to concurrently
+// without contention ("false sharing").
+#ifdef __cpp_lib_hardware_interference_size
+// The value is used only for alignment within this library, so it's fine if
+// it differs between compiler versions or flags.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+constexpr std::size_t kCacheLineSize =
+    std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr std::size_t kCacheLineSize = 64;
+#endif
+
+// Layout policies for `Local3StateRcu`, see its `Layout` template parameter.
+//
+// Keeps all the state packed together. Suitable when there are many
+// instances, or when contention between the Reader and the Updater is rare,
+// such as when updates are infrequent.
+struct CompactLayout {
+  static constexpr std::size_t kAlignment = 1;
+};
+// Places the state owned by the Reader, the state owned by the Updater, the
+// shared atomic index and each of the 3 instances of `T` on separate cache
+// lines. This avoids lines bouncing between the two threads' cores on
+// operations that don't need to communicate, at the cost of memory.
+//
+// Note that before C++17 heap allocations (including `std::make_shared`)
+// aren't guaranteed to honor the alignment.
+struct CacheLinePaddedLayout {
+  static constexpr std::size_t kAlignment = kCacheLineSize;
+};
+
 // Provides a RCU-like framework to exchange values between just two threads
 // "Reader" and "Updater" (hence "Local"). It consists of 3 instances of `T`
 // such that:
@@ -48,7 +87,9 @@ namespace simple_rcu {
 // instances of `T` internally between the two threads. If they need to be
 // constructed and deconstructed as they pass between the Updater and the
 // Reader, wrap `T` into `absl::optional` or `std::unique_ptr`.
-template <typename T>
+//
+// `Layout` is either `CompactLayout` or `CacheLinePaddedLayout`.
+template <typename T, typename Layout = CompactLayout>
 class Local3StateRcu {
  public:
   // Builds an instance by initializing the internal three `T` variables to
@@ -62,10 +103,11 @@ class Local3StateRcu {
   //
   // `T` must be moveable.
   Local3StateRcu(T read, T update, T reclaim)
-      : values_{std::move(read), std::move(update), std::move(reclaim)},
+      : values_{{Aligned<T>(std::move(read)), Aligned<T>(std::move(update)),
+                 Aligned<T>(std::move(reclaim))}},
         next_read_index_(kNullIndex),
-        read_{.index = 0},
-        update_{.index = 1, .next_index = 0} {}
+        read_(ReadState{.index = 0}),
+        update_(UpdateState{.index = 1, .next_index = 0}) {}
   // Builds an instance by initializing the internal three `T` variables to a
   // given single values. `T` must be copyable.
   explicit Local3StateRcu(const T& value)
@@ -75,13 +117,13 @@ class Local3StateRcu {
   Local3StateRcu()
       : values_(),
         next_read_index_(kNullIndex),
-        read_{.index = 0},
-        update_{.index = 1, .next_index = 0} {}
+        read_(ReadState{.index = 0}),
+        update_(UpdateState{.index = 1, .next_index = 0}) {}
   ~Local3StateRcu() noexcept = default;
 
   // Reference to the value that can be manipulated by the reading thread.
-  T& Read() noexcept { return values_[read_.index]; }
-  const T& Read() const noexcept { return values_[read_.index]; }
+  T& Read() noexcept { return values_[read_->index].value; }
+  const T& Read() const noexcept { return values_[read_->index].value; }
 
   // Advance the Reader to a new value, if possible.
   //
@@ -91,24 +133,45 @@ class Local3StateRcu {
   // be considered invalid and must not be used any more.
   //
   // If the in-flight instance is already "R->U", does nothing and returns
-  // `false`.
+  // `false`. This also clears a mark set by `MarkReadWaiting()`.
   //
   // See also `TryUpdate()` which has the same semantics for the updater
   // thread.
   bool TryRead() noexcept {
     Index next_read_index =
-        next_read_index_.exchange(kNullIndex, std::memory_order_acq_rel);
-    if (next_read_index != kNullIndex) {
-      read_.index = next_read_index;
+        next_read_index_->exchange(kNullIndex, std::memory_order_acq_rel);
+    if (next_read_index >= 0) {
+      read_->index = next_read_index;
       return true;
     } else {
       return false;
     }
   }
 
+  // Marks the Reader as waiting for a new value, so that the next
+  // `TryUpdate()` or `ForceUpdate()` that provides one reports it to the
+  // Updater, which can then wake up the Reader. Afterwards `ReadWaiting()`
+  // returns `true` until then (or until `TryRead()`).
+  //
+  // Returns `false` without marking anything if the in-flight instance is
+  // already "U->R", that is, if `TryRead()` would return `true`.
+  bool MarkReadWaiting() noexcept {
+    Index expected = kNullIndex;
+    return next_read_index_->compare_exchange_strong(
+               expected, kWaitingIndex, std::memory_order_acq_rel,
+               std::memory_order_acquire) ||
+           expected == kWaitingIndex;
+  }
+
+  // Whether the mark set by `MarkReadWaiting()` is still present.
+  // This is the only method that may be called by any thread.
+  bool ReadWaiting() const noexcept {
+    return next_read_index_->load(std::memory_order_acquire) == kWaitingIndex;
+  }
+
   // Reference to the value that can be manipulated by the updating thread.
-  T& Update() noexcept { return values_[update_.index]; }
-  const T& Update() const noexcept { return values_[update_.index]; }
+  T& Update() noexcept { return values_[update_->index].value; }
+  const T& Update() const noexcept { return values_[update_->index].value; }
 
   // Advance the Updater to a new value, if possible.
   //
@@ -121,20 +184,26 @@ class Local3StateRcu {
   // `false`.
   //
   // See also `TryRead()` which has the same semantics for the updater thread.
-  bool TryUpdate() noexcept {
+  //
+  // If `reader_waiting` isn't `nullptr`, it's set to `true` if the Reader has
+  // been marked by `MarkReadWaiting()`, otherwise left unchanged.
+  bool TryUpdate(bool* reader_waiting = nullptr) noexcept {
     Index old_next_read_index = kNullIndex;
     // Use relaxed memory ordering on failure, since in this case there is no
-    // related observable memory access.
-    if (next_read_index_.compare_exchange_strong(
-            old_next_read_index, update_.index,
-            /*success=*/std::memory_order_acq_rel,
-            /*failure=*/std::memory_order_relaxed)) {
-      update_.RotateAfterNext();
-      return true;
-    } else {
-      // The reader hasn't advanced yet. Nothing to do.
-      return false;
+    // related observable memory access. Retries only if the Reader has
+    // concurrently marked or unmarked itself as waiting.
+    while (!next_read_index_->compare_exchange_weak(
+        old_next_read_index, update_->index,
+        /*success=*/std::memory_order_acq_rel,
+        /*failure=*/std::memory_order_relaxed)) {
+      if (old_next_read_index >= 0) {
+        // The reader hasn't advanced yet. Nothing to do.
+        return false;
+      }
     }
+    update_->RotateAfterNext();
+    SetIfWaiting(old_next_read_index, reader_waiting);
+    return true;
   }
 
   // Makes the value stored in `Update()` the new in-flight "U->R" value.
@@ -150,21 +219,35 @@ class Local3StateRcu {
   //
   // Compared to `TryUpdate()` this method forces an update even if the
   // reader hasn't advanced yet.
-  bool ForceUpdate() noexcept {
+  //
+  // If `reader_waiting` isn't `nullptr`, it's set to `true` if the Reader has
+  // been marked by `MarkReadWaiting()`, otherwise left unchanged.
+  bool ForceUpdate(bool* reader_waiting = nullptr) noexcept {
     Index old_next_read_index =
-        next_read_index_.exchange(update_.index, std::memory_order_acq_rel);
-    if (old_next_read_index == kNullIndex) {
-      update_.RotateAfterNext();
+        next_read_index_->exchange(update_->index, std::memory_order_acq_rel);
+    if (old_next_read_index < 0) {
+      update_->RotateAfterNext();
+      SetIfWaiting(old_next_read_index, reader_waiting);
       return true;
     } else {
       // The reader hasn't advanced yet.
       // This is just a swap of update_index_ and next_read_index_.
-      update_.next_index = update_.index;
-      update_.index = old_next_read_index;
+      update_->next_index = update_->index;
+      update_->index = old_next_read_index;
       return false;
     }
   }
 
+  // Whether the in-flight instance is "U->R", that is, whether the Reader
+  // hasn't advanced to the value last provided by the Updater yet. In this
+  // case `ForceUpdate()` would replace that value before it's ever read.
+  //
+  // Since the Reader can advance concurrently, the result may be outdated
+  // when it's `true`, but never when it's `false`.
+  bool PendingRead() const noexcept {
+    return next_read_index_->load(std::memory_order_acquire) >= 0;
+  }
+
   // Returns a pointer to the in-flight instance if it is "R->U". The returned
   // pointer is valid only until one of the state-changing Updater's methods is
   // called. If the in-flight instance is "U->R", returns `nullptr`.
@@ -172,13 +255,29 @@ class Local3StateRcu {
   // This allows to access the instance passed by the Reader to the Updater
   // without providing a new value by `ForceUpdate()` or `TryUpdate()`.
   T* ReclaimByUpdate() noexcept {
-    if (next_read_index_.load(std::memory_order_acquire) == kNullIndex) {
-      return &values_[update_.OldReadIndex()];
+    if (next_read_index_->load(std::memory_order_acquire) < 0) {
+      return &values_[update_->OldReadIndex()].value;
     } else {
       return nullptr;
     }
   }
 
+  // Returns the instance the Reader is bound to, as far as the Updater can
+  // tell: If the in-flight instance is "R->U", it's the one last provided by
+  // the Updater. Otherwise the Reader hasn't advanced to it yet and it's the
+  // previous one. Since the Reader can advance concurrently, the result may
+  // lag behind, but never points to an instance the Reader hasn't reached yet.
+  //
+  // The Reader may be accessing the instance concurrently, therefore the
+  // Updater may only read parts of it that the Reader doesn't modify.
+  const T& PeekReadByUpdate() const noexcept {
+    if (next_read_index_->load(std::memory_order_acquire) < 0) {
+      return values_[update_->next_index].value;
+    } else {
+      return values_[update_->OldReadIndex()].value;
+    }
+  }
+
  private:
 #ifdef __cpp_lib_atomic_lock_free_type_aliases
   using Index = typename std::atomic_signed_lock_free::value_type;
@@ -192,28 +291,37 @@ class Local3StateRcu {
 #endif
 
   static constexpr Index kNullIndex = -1;
+  // Like `kNullIndex`, with the Reader waiting for a new value.
+  static constexpr Index kWaitingIndex = -2;
+
+  static void SetIfWaiting(Index old_next_read_index,
+                           bool* reader_waiting) noexcept {
+    if (old_next_read_index == kWaitingIndex && reader_waiting != nullptr) {
+      *reader_waiting = true;
+    }
+  }
+
+  // Holds a `U` aligned as required by `Layout`. For `CacheLinePaddedLayout`
+  // this ensures it doesn't share a cache line with any other member.
+  template <typename U>
+  struct alignas(Layout::kAlignment > alignof(U) ? Layout::kAlignment
+                                                 : alignof(U)) Aligned {
+    template <typename... Args>
+    explicit Aligned(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+    U* operator->() noexcept { return &value; }
+    const U* operator->() const noexcept { return &value; }
+
+    U value;
+  };
 
-  // Storage for instances of `T` that are juggled around between the reader
-  // and updater threads.
-  // All the variables below are indices into `values_`, that is, from set
-  // {0, 1, 2}.
-  std::array<T, 3> values_;
-  // If `kNullIndex`, there is no new value available to the reader thread.
-  // Invariants in this case:
-  //  read_.index == update_.next_index != update_.index
-  // Otherwise it contains the index holding a new value available to the
-  // reader.
-  // Invariants in this case:
-  //  * {read_.index, update_.index, update_.next_index} = {0, 1, 2}
-  //  * next_read_index_.load() == update_.next_index
-  std::atomic<Index> next_read_index_;
   // Accessed only by the "read" thread:
-  struct {
+  struct ReadState {
     // The reader thread can manipulate the value at this index.
     Index index;
-  } read_;
+  };
   // Accessed only by the "update" thread.
-  struct {
+  struct UpdateState {
     // After `index` is pushed to `next_read_index_` above, rotate remaining
     // indices: next_index <- index <- old read index.
     inline void RotateAfterNext() noexcept {
@@ -222,7 +330,7 @@ class Local3StateRcu {
       index = old_read_index;  // To be reclaimed.
     }
 
-    Index OldReadIndex() noexcept {
+    Index OldReadIndex() const noexcept {
       return (0 + 1 + 2) - (index + next_index);
       ;
     }
@@ -231,9 +339,33 @@ class Local3StateRcu {
     Index index;
     // The last known value of `next_read_index_` known to the updater thread.
     Index next_index;
-  } update_;
+  };
+
+  // Storage for instances of `T` that are juggled around between the reader
+  // and updater threads.
+  // All the variables below are indices into `values_`, that is, from set
+  // {0, 1, 2}.
+  std::array<Aligned<T>, 3> values_;
+  // If `kNullIndex` or `kWaitingIndex`, there is no new value available to
+  // the reader thread. Invariants in this case:
+  //  read_.index == update_.next_index != update_.index
+  // Otherwise it contains the index holding a new value available to the
+  // reader.
+  // Invariants in this case:
+  //  * {read_.index, update_.index, update_.next_index} = {0, 1, 2}
+  //  * next_read_index_.load() == update_.next_index
+  Aligned<std::atomic<Index>> next_read_index_;
+  Aligned<ReadState> read_;
+  Aligned<UpdateState> update_;
 };
 
+template <typename T, typename Layout>
+constexpr typename Local3StateRcu<T, Layout>::Index
+    Local3StateRcu<T, Layout>::kNullIndex;
+template <typename T, typename Layout>
+constexpr typename Local3StateRcu<T, Layout>::Index
+    Local3StateRcu<T, Layout>::kWaitingIndex;
+
 }  // namespace simple_rcu
 
 #endif  // _SIMPLE_RCU_LOCAL_3STATE_RCU_H
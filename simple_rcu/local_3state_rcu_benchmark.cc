@@ -0,0 +1,101 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// A value of 1KB, passed between the threads as a whole.
+struct Kilobyte {
+  Kilobyte() : values() {}
+
+  std::array<int_fast64_t, 1024 / sizeof(int_fast64_t)> values;
+};
+
+int_fast64_t& Tag(int_fast64_t& value) { return value; }
+int_fast64_t& Tag(Kilobyte& value) { return value.values[0]; }
+
+// Measures the round-trip latency of passing a value from one thread to
+// another and back using a `Local3StateRcu` with the given `Layout` in each
+// direction.
+template <typename T, typename Layout>
+static void BM_PingPong(benchmark::State& state) {
+  Local3StateRcu<T, Layout> ping;
+  Local3StateRcu<T, Layout> pong;
+  std::atomic<bool> finished(false);
+  // The Reader of `ping` and the Updater of `pong`.
+  std::thread echo([&]() {
+    while (!finished.load(std::memory_order_relaxed)) {
+      if (ping.TryRead()) {
+        pong.Update() = ping.Read();
+        pong.ForceUpdate();
+      }
+    }
+  });
+  int_fast64_t i = 0;
+  for (auto _ : state) {
+    Tag(ping.Update()) = ++i;
+    ping.ForceUpdate();
+    while (!pong.TryRead() || (Tag(pong.Read()) != i)) {
+    }
+  }
+  finished.store(true, std::memory_order_relaxed);
+  echo.join();
+}
+BENCHMARK_TEMPLATE(BM_PingPong, int_fast64_t, CompactLayout)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PingPong, int_fast64_t, CacheLinePaddedLayout)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PingPong, Kilobyte, CompactLayout)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_PingPong, Kilobyte, CacheLinePaddedLayout)
+    ->UseRealTime();
+
+// Measures the cost of a `TryRead` when there is no new value, the common
+// case of a Reader.
+template <typename Layout>
+static void BM_TryReadUnchanged(benchmark::State& state) {
+  Local3StateRcu<int_fast64_t, Layout> rcu;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(rcu.TryRead());
+  }
+}
+BENCHMARK_TEMPLATE(BM_TryReadUnchanged, CompactLayout);
+BENCHMARK_TEMPLATE(BM_TryReadUnchanged, CacheLinePaddedLayout);
+
+// Measures the cost of a single-threaded round of `ForceUpdate` and
+// `TryRead`.
+template <typename T, typename Layout>
+static void BM_ForceUpdateAndRead(benchmark::State& state) {
+  Local3StateRcu<T, Layout> rcu;
+  int_fast64_t i = 0;
+  for (auto _ : state) {
+    Tag(rcu.Update()) = ++i;
+    rcu.ForceUpdate();
+    rcu.TryRead();
+    benchmark::DoNotOptimize(Tag(rcu.Read()));
+  }
+}
+BENCHMARK_TEMPLATE(BM_ForceUpdateAndRead, int_fast64_t, CompactLayout);
+BENCHMARK_TEMPLATE(BM_ForceUpdateAndRead, int_fast64_t, CacheLinePaddedLayout);
+BENCHMARK_TEMPLATE(BM_ForceUpdateAndRead, Kilobyte, CompactLayout);
+BENCHMARK_TEMPLATE(BM_ForceUpdateAndRead, Kilobyte, CacheLinePaddedLayout);
+
+}  // namespace
+}  // namespace simple_rcu
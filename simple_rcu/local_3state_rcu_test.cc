@@ -14,6 +14,9 @@
 
 #include "simple_rcu/local_3state_rcu.h"
 
+#include <cstdint>
+#include <cstdlib>
+
 #include "gtest/gtest.h"
 
 namespace simple_rcu {
@@ -147,5 +150,82 @@ TEST(Local3StateRcuTest, AlternatingTryUpdatesAndReads) {
   }
 }
 
+TEST(Local3StateRcuTest, PeekReadByUpdate) {
+  Local3StateRcu<int> rcu(0);
+  EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read());
+  rcu.Update() = 42;
+  ASSERT_TRUE(rcu.ForceUpdate());
+  EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read())
+      << "Must be the previous instance until the Reader advances";
+  rcu.Update() = 73;
+  ASSERT_FALSE(rcu.ForceUpdate());
+  EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read());
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read())
+      << "Must be the new instance after the Reader advances";
+  EXPECT_EQ(rcu.PeekReadByUpdate(), 73);
+}
+
+TEST(Local3StateRcuTest, PendingRead) {
+  Local3StateRcu<int> rcu(0);
+  EXPECT_FALSE(rcu.PendingRead());
+  rcu.Update() = 42;
+  ASSERT_TRUE(rcu.ForceUpdate());
+  EXPECT_TRUE(rcu.PendingRead()) << "The Reader hasn't advanced yet";
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_FALSE(rcu.PendingRead());
+  EXPECT_TRUE(rcu.MarkReadWaiting());
+  EXPECT_FALSE(rcu.PendingRead()) << "A waiting Reader has nothing pending";
+}
+
+TEST(Local3StateRcuTest, MarkReadWaiting) {
+  Local3StateRcu<int> rcu(0);
+  bool reader_waiting = false;
+  ASSERT_TRUE(rcu.ForceUpdate(&reader_waiting));
+  EXPECT_FALSE(reader_waiting);
+  EXPECT_FALSE(rcu.MarkReadWaiting())
+      << "Must not wait when a new value is available";
+  EXPECT_FALSE(rcu.ReadWaiting());
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_TRUE(rcu.MarkReadWaiting());
+  EXPECT_TRUE(rcu.MarkReadWaiting()) << "Marking must be idempotent";
+  EXPECT_TRUE(rcu.ReadWaiting());
+  EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read());
+  EXPECT_NE(rcu.ReclaimByUpdate(), nullptr);
+  rcu.Update() = 42;
+  ASSERT_TRUE(rcu.TryUpdate(&reader_waiting))
+      << "A waiting Reader mustn't prevent advancing";
+  EXPECT_TRUE(reader_waiting);
+  EXPECT_FALSE(rcu.ReadWaiting());
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Read(), 42);
+  // A mark left behind is cleared by `TryRead()`.
+  EXPECT_TRUE(rcu.MarkReadWaiting());
+  EXPECT_FALSE(rcu.TryRead());
+  EXPECT_FALSE(rcu.ReadWaiting());
+  reader_waiting = false;
+  rcu.Update() = 73;
+  ASSERT_TRUE(rcu.ForceUpdate(&reader_waiting));
+  EXPECT_FALSE(reader_waiting);
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Read(), 73);
+}
+
+TEST(Local3StateRcuTest, CacheLinePaddedLayout) {
+  Local3StateRcu<int, CacheLinePaddedLayout> rcu(/*read=*/0, /*update=*/0,
+                                                 /*reclaim=*/42);
+  EXPECT_GE(sizeof(rcu), 6 * kCacheLineSize);
+  EXPECT_GE(std::abs(reinterpret_cast<intptr_t>(&rcu.Read()) -
+                     reinterpret_cast<intptr_t>(&rcu.Update())),
+            kCacheLineSize)
+      << "The values must not share a cache line";
+  ASSERT_NE(rcu.ReclaimByUpdate(), nullptr);
+  EXPECT_EQ(*rcu.ReclaimByUpdate(), 42);
+  rcu.Update() = 73;
+  ASSERT_TRUE(rcu.ForceUpdate());
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Read(), 73);
+}
+
 }  // namespace
 }  // namespace simple_rcu
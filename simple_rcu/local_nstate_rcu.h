@@ -0,0 +1,300 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_LOCAL_NSTATE_RCU_H
+#define _SIMPLE_RCU_LOCAL_NSTATE_RCU_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "absl/numeric/bits.h"
+#include "absl/utility/utility.h"
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+
+// Generalization of `Local3StateRcu` to `N` instances of `T`, which allows
+// the Reader to pin instances for a long time while the Updater keeps
+// passing new values to it:
+//
+// - One is accessed by the Reader via the `Read()` reference.
+// - Any number are pinned by the Reader, see `Pin()`.
+// - One is accessed by the Updater via the `Update()` reference.
+// - One is "in flight", either "U->R" holding a new value or "R->U" being
+//   returned to the Updater, as in `Local3StateRcu`.
+// - The rest are free, owned by the Updater.
+//
+// With `Local3StateRcu` a Reader that keeps a value for a long time can't
+// advance at all, while the Updater keeps overwriting the in-flight value.
+// Here the Reader pins the value instead, and can still advance to new values
+// (for example for short-lived nested reads), as long as at most `N - 2`
+// instances are bound to `Read()` or pinned. Unpinned instances are returned
+// to the Updater.
+//
+// The handshake is the same single atomic index as in `Local3StateRcu`, which
+// additionally carries the instance the Reader returns when advancing. Only
+// instances unpinned after the Reader advanced past them are returned through
+// a separate atomic bit mask.
+//
+// The same threading rules as for `Local3StateRcu` apply: The Reader calls
+// only the `...Read...`, `Pin...` and `Unpin` methods, the Updater only the
+// `...Update...` ones.
+//
+// `N` must be between 3 and 64. With `N = 3` it behaves like `Local3StateRcu`,
+// but a pinned `Read()` instance prevents advancing.
+// `Layout` is either `CompactLayout` or `CacheLinePaddedLayout`.
+template <typename T, size_t N, typename Layout = CompactLayout>
+class LocalNStateRcu {
+ public:
+  static_assert(N >= 3, "At least 3 instances are required");
+  static_assert(N <= 64, "Instances are tracked in a 64-bit mask");
+
+  // Identifies an instance pinned by `Pin()`.
+  using PinId = size_t;
+
+  // Builds an instance by initializing the internal `N` variables to a given
+  // value. `T` must be copyable.
+  //
+  // The initial state is the same as of `Local3StateRcu`: `TryRead()` returns
+  // `false`, while `TryUpdate()` returns `true`.
+  explicit LocalNStateRcu(const T& value)
+      : LocalNStateRcu(value, absl::make_index_sequence<N>()) {}
+  // Builds an instance by initializing the internal `N` variables to `T()`.
+  LocalNStateRcu() : LocalNStateRcu(T()) {}
+  ~LocalNStateRcu() noexcept = default;
+
+  // Reference to the value that can be manipulated by the reading thread.
+  T& Read() noexcept { return values_[read_->index].value; }
+  const T& Read() const noexcept { return values_[read_->index].value; }
+
+  // Advance the Reader to a new value, if possible.
+  //
+  // Like `Local3StateRcu::TryRead()`, except that if the current `Read()`
+  // instance is pinned, it stays valid as `Pinned()`. If too many instances
+  // would be held by the Reader then (see above), doesn't advance and returns
+  // `false`.
+  //
+  // When there is no new value, this is just an atomic load.
+  bool TryRead() noexcept {
+    if (next_read_index_->load(std::memory_order_acquire) < 0) {
+      return false;  // "R->U", nothing new.
+    }
+    const bool keep = read_->pins[read_->index] > 0;
+    if (keep && read_->pinned + 1 > N - 2) {
+      return false;
+    }
+    // Only the Reader replaces a "U->R" index with a "R->U" one, so the
+    // result is a "U->R" index, possibly newer than the one loaded above.
+    read_->index = next_read_index_->exchange(
+        keep ? kNullIndex : Returned(read_->index), std::memory_order_acq_rel);
+    return true;
+  }
+
+  // Pins the instance currently bound to `Read()`, so that it remains valid
+  // and unchanged after `TryRead()` advances, until a matching `Unpin`.
+  // Pins are counted, an instance can be pinned several times.
+  PinId Pin() noexcept {
+    const size_t index = static_cast<size_t>(read_->index);
+    if (read_->pins[index]++ == 0) {
+      read_->pinned++;
+    }
+    return index;
+  }
+
+  // Reference to an instance pinned by `Pin()`.
+  T& Pinned(PinId pin) noexcept { return values_[pin].value; }
+  const T& Pinned(PinId pin) const noexcept { return values_[pin].value; }
+
+  // Releases a pin obtained by `Pin()`. If it was the last pin of an instance
+  // no longer bound to `Read()`, the instance is returned to the Updater.
+  void Unpin(PinId pin) noexcept {
+    if (--read_->pins[pin] == 0) {
+      read_->pinned--;
+      if (static_cast<Index>(pin) != read_->index) {
+        released_->fetch_or(Mask(pin), std::memory_order_release);
+      }
+    }
+  }
+
+  // Reference to the value that can be manipulated by the updating thread.
+  T& Update() noexcept { return values_[update_->index].value; }
+  const T& Update() const noexcept { return values_[update_->index].value; }
+
+  // Advance the Updater to a new value, if possible. See
+  // `Local3StateRcu::TryUpdate()`. The instance bound to `Update()` afterwards
+  // is the one returned by the Reader, or a free one if the Reader had pinned
+  // it.
+  bool TryUpdate() noexcept {
+    const Index old = next_read_index_->load(std::memory_order_acquire);
+    if (old >= 0) {
+      return false;  // The reader hasn't advanced yet.
+    }
+    // The Reader doesn't modify a "R->U" index, so there is no race.
+    next_read_index_->store(update_->index, std::memory_order_release);
+    AdvanceUpdate(old);
+    return true;
+  }
+
+  // Makes the value stored in `Update()` the new in-flight "U->R" value. See
+  // `Local3StateRcu::ForceUpdate()`.
+  bool ForceUpdate() noexcept {
+    const Index old =
+        next_read_index_->exchange(update_->index, std::memory_order_acq_rel);
+    if (old >= 0) {
+      // The reader hasn't advanced yet.
+      // This is just a swap of update_index_ and next_read_index_.
+      update_->next_index = update_->index;
+      update_->index = old;
+      return false;
+    }
+    AdvanceUpdate(old);
+    return true;
+  }
+
+  // Returns a pointer to the in-flight instance if it is "R->U" and the
+  // Reader has returned an instance (that is, hasn't pinned it). See
+  // `Local3StateRcu::ReclaimByUpdate()`.
+  T* ReclaimByUpdate() noexcept {
+    const Index old = next_read_index_->load(std::memory_order_acquire);
+    return old < kNullIndex ? &values_[ReturnedIndex(old)].value : nullptr;
+  }
+
+  // Returns the instance bound to `Read()`, as far as the Updater can tell.
+  // See `Local3StateRcu::PeekReadByUpdate()`. Doesn't include pinned
+  // instances.
+  const T& PeekReadByUpdate() const noexcept {
+    if (next_read_index_->load(std::memory_order_acquire) < 0) {
+      return values_[update_->next_index].value;
+    } else {
+      return values_[update_->read_index].value;
+    }
+  }
+
+ private:
+#ifdef __cpp_lib_atomic_lock_free_type_aliases
+  using Index = typename std::atomic_signed_lock_free::value_type;
+#else
+  using Index = std::ptrdiff_t;
+#endif
+#ifdef __cpp_lib_atomic_is_always_lock_free
+  static_assert(std::atomic<Index>::is_always_lock_free,
+                "Not lock-free on this architecture, please report this as a "
+                "bug on the project's GitHub page");
+#endif
+  using Bits = uint_fast64_t;
+
+  // Values of `next_read_index_`: Non-negative ones are "U->R" indices.
+  // Negative ones are "R->U", either `kNullIndex` when the Reader returned
+  // nothing (as it pinned its instance), or `Returned(index)`.
+  static constexpr Index kNullIndex = -1;
+  static Index Returned(Index index) noexcept { return kNullIndex - 1 - index; }
+  static Index ReturnedIndex(Index returned) noexcept {
+    return kNullIndex - 1 - returned;
+  }
+
+  static Bits Mask(size_t index) noexcept { return Bits{1} << index; }
+
+  // Holds a `U` aligned as required by `Layout`. For `CacheLinePaddedLayout`
+  // this ensures it doesn't share a cache line with any other member.
+  template <typename U>
+  struct alignas(Layout::kAlignment > alignof(U) ? Layout::kAlignment
+                                                 : alignof(U)) Aligned {
+    template <typename... Args>
+    explicit Aligned(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+    U* operator->() noexcept { return &value; }
+    const U* operator->() const noexcept { return &value; }
+
+    U value;
+  };
+
+  // Accessed only by the "read" thread:
+  struct ReadState {
+    ReadState() : index(0), pinned(0), pins() {}
+
+    // The reader thread can manipulate the value at this index.
+    Index index;
+    // The number of instances with non-zero `pins`.
+    size_t pinned;
+    std::array<uint_fast32_t, N> pins;
+  };
+  // Accessed only by the "update" thread.
+  struct UpdateState {
+    // Instance 2 is initially "R->U", 3 and above free.
+    UpdateState()
+        : index(1), next_index(0), read_index(0), free(~Bits{0} << 3) {}
+
+    // The updater thread can manipulate the value at this index.
+    Index index;
+    // The last known value of `next_read_index_` known to the updater thread.
+    Index next_index;
+    // The instance the Reader is bound to while `next_index` is "U->R".
+    Index read_index;
+    // Free instances. May contain bits above `N`, which are never used.
+    Bits free;
+  };
+
+  template <size_t... I>
+  LocalNStateRcu(const T& value, absl::index_sequence<I...>)
+      : values_{{Aligned<T>((static_cast<void>(I), value))...}},
+        next_read_index_(Returned(2)),
+        released_(0),
+        read_(),
+        update_() {}
+
+  // Called after `next_index` was passed to the Reader, and `update_->index`
+  // is the new "U->R" instance, replacing "R->U" `old`.
+  void AdvanceUpdate(Index old) noexcept {
+    update_->read_index = update_->next_index;
+    update_->next_index = update_->index;
+    if (old != kNullIndex) {
+      update_->index = ReturnedIndex(old);
+      return;
+    }
+    // At most `N - 2` instances are held by the Reader, so at least one of
+    // the remaining ones, apart from the "U->R" one, is free.
+    if ((update_->free & kUsed) == 0) {
+      update_->free |= released_->exchange(0, std::memory_order_acquire);
+    }
+    const int index = absl::countr_zero(update_->free & kUsed);
+    update_->free &= ~Mask(index);
+    update_->index = index;
+  }
+
+  static constexpr Bits kUsed = N == 64 ? ~Bits{0} : (Bits{1} << N) - 1;
+
+  // Storage for instances of `T` that are juggled around between the reader
+  // and updater threads.
+  std::array<Aligned<T>, N> values_;
+  // See `kNullIndex`. If "U->R", it's equal to `update_.next_index`.
+  Aligned<std::atomic<Index>> next_read_index_;
+  // Instances released by `Unpin` that the Updater hasn't taken yet.
+  Aligned<std::atomic<Bits>> released_;
+  Aligned<ReadState> read_;
+  Aligned<UpdateState> update_;
+};
+
+template <typename T, size_t N, typename Layout>
+constexpr typename LocalNStateRcu<T, N, Layout>::Index
+    LocalNStateRcu<T, N, Layout>::kNullIndex;
+template <typename T, size_t N, typename Layout>
+constexpr typename LocalNStateRcu<T, N, Layout>::Bits
+    LocalNStateRcu<T, N, Layout>::kUsed;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_LOCAL_NSTATE_RCU_H
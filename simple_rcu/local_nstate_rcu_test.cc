@@ -0,0 +1,157 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/local_nstate_rcu.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(LocalNStateRcuTest, InitialStateLikeLocal3StateRcu) {
+  LocalNStateRcu<int_fast32_t, 5> rcu(42);
+  EXPECT_EQ(rcu.Read(), 42);
+  EXPECT_EQ(rcu.Update(), 42);
+  EXPECT_FALSE(rcu.TryRead()) << "Read shouldn't advance in an initial state";
+  ASSERT_NE(rcu.ReclaimByUpdate(), nullptr);
+  EXPECT_NE(rcu.ReclaimByUpdate(), &rcu.Update());
+  EXPECT_NE(rcu.ReclaimByUpdate(), &rcu.Read());
+  ASSERT_TRUE(rcu.ForceUpdate()) << "Update should advance in an initial state";
+  EXPECT_EQ(rcu.ReclaimByUpdate(), nullptr);
+  EXPECT_NE(&rcu.Update(), &rcu.Read());
+}
+
+TEST(LocalNStateRcuTest, AlternatingUpdatesAndReads) {
+  LocalNStateRcu<int, 4> rcu(0);
+  for (int i = 1; i <= 10; i++) {
+    SCOPED_TRACE(i);
+    rcu.Update() = -1;  // Value that we'll overwrite later.
+    ASSERT_TRUE(rcu.ForceUpdate()) << "Read should have advanced";
+    rcu.Update() = i;
+    ASSERT_FALSE(rcu.ForceUpdate())
+        << "The second trigger doesn't claim a value from the reader";
+    EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read());
+    ASSERT_TRUE(rcu.TryRead());
+    EXPECT_EQ(rcu.Read(), i) << "Read() should now point to the new value";
+    EXPECT_EQ(&rcu.PeekReadByUpdate(), &rcu.Read());
+    ASSERT_FALSE(rcu.TryRead());
+  }
+}
+
+TEST(LocalNStateRcuTest, DoubleTryUpdateBetweenReads) {
+  LocalNStateRcu<int, 3> rcu;
+  rcu.Update() = 42;
+  EXPECT_TRUE(rcu.TryUpdate()) << "Read should have advanced";
+  rcu.Update() = 73;
+  EXPECT_FALSE(rcu.TryUpdate()) << "Read shouldn't have advanced";
+  EXPECT_EQ(rcu.Update(), 73);
+  EXPECT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Read(), 42);
+  EXPECT_FALSE(rcu.TryRead());
+}
+
+TEST(LocalNStateRcuTest, PinnedInstanceSurvivesUpdates) {
+  LocalNStateRcu<int, 4> rcu(0);
+  rcu.Read() = 42;
+  const LocalNStateRcu<int, 4>::PinId pin = rcu.Pin();
+  for (int i = 1; i <= 10; i++) {
+    SCOPED_TRACE(i);
+    rcu.Update() = i;
+    rcu.ForceUpdate();
+    ASSERT_TRUE(rcu.TryRead())
+        << "Nested readers must keep advancing while an instance is pinned";
+    EXPECT_EQ(rcu.Read(), i);
+    EXPECT_NE(&rcu.Update(), &rcu.Pinned(pin));
+    EXPECT_EQ(rcu.Pinned(pin), 42) << "The pinned value must stay intact";
+  }
+  rcu.Unpin(pin);
+  // Keep pinning while advancing, so that the Reader never returns instances
+  // directly and the Updater must take the ones released by `Unpin`.
+  bool returned = false;
+  for (int i = 0; i < 8; i++) {
+    const auto held = rcu.Pin();
+    rcu.Update() = -1;
+    rcu.ForceUpdate();
+    returned |= &rcu.Update() == &rcu.Pinned(pin);
+    ASSERT_TRUE(rcu.TryRead());
+    rcu.Unpin(held);
+  }
+  EXPECT_TRUE(returned) << "An unpinned instance must return to the Updater";
+}
+
+TEST(LocalNStateRcuTest, TooManyPinsPreventAdvancing) {
+  LocalNStateRcu<int, 4> rcu(0);
+  const auto first = rcu.Pin();
+  rcu.Update() = 1;
+  ASSERT_TRUE(rcu.ForceUpdate());
+  ASSERT_TRUE(rcu.TryRead());
+  const auto second = rcu.Pin();
+  rcu.Update() = 2;
+  ASSERT_TRUE(rcu.ForceUpdate()) << "One instance must remain free";
+  EXPECT_FALSE(rcu.TryRead())
+      << "Advancing would hold more than N - 2 instances";
+  EXPECT_EQ(rcu.Read(), 1);
+  rcu.Unpin(first);
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Read(), 2);
+  EXPECT_EQ(rcu.Pinned(second), 1);
+  rcu.Unpin(second);
+}
+
+TEST(LocalNStateRcuTest, NestedPinsOfTheSameInstance) {
+  LocalNStateRcu<int, 4> rcu(7);
+  const auto outer = rcu.Pin();
+  const auto inner = rcu.Pin();
+  EXPECT_EQ(outer, inner);
+  rcu.Unpin(inner);
+  rcu.Update() = 8;
+  ASSERT_TRUE(rcu.ForceUpdate());
+  ASSERT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Pinned(outer), 7) << "Still pinned by the outer pin";
+  rcu.Unpin(outer);
+}
+
+TEST(LocalNStateRcuTest, ConcurrentUpdatesAndPinnedReads) {
+  LocalNStateRcu<int_fast64_t, 6, CacheLinePaddedLayout> rcu(0);
+  std::atomic<bool> finished(false);
+  std::thread updater([&]() {
+    for (int_fast64_t i = 1; i <= 100000; i++) {
+      rcu.Update() = i;
+      rcu.ForceUpdate();
+    }
+    finished.store(true);
+  });
+  int_fast64_t last = 0;
+  while (!finished.load()) {
+    rcu.TryRead();
+    const auto pin = rcu.Pin();
+    const int_fast64_t pinned = rcu.Pinned(pin);
+    ASSERT_GE(pinned, last) << "Values must be observed in order";
+    for (int nested = 0; nested < 3; nested++) {
+      rcu.TryRead();
+      ASSERT_GE(rcu.Read(), pinned);
+    }
+    ASSERT_EQ(rcu.Pinned(pin), pinned) << "The pinned value must not change";
+    last = rcu.Read();
+    rcu.Unpin(pin);
+  }
+  updater.join();
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,154 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_MAPPED_FILE_H
+#define _SIMPLE_RCU_MAPPED_FILE_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define _SIMPLE_RCU_HAS_MMAP 1
+#endif
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+
+// The contents of a file mapped read-only into memory, unmapped on
+// destruction.
+//
+// Meant to be published through `Rcu<MappedFile>` (see `UpdateFromFile`): A
+// value in a flat, offset-based layout is serialized into a file once, and
+// processes then map it instead of building the value at startup. Readers
+// access it in place through `At`, without copying or parsing. Pages are
+// loaded lazily (and usually straight from the page cache after a restart)
+// and are shared by all processes on the host that map the same file.
+//
+// Replacing the value by mapping a new file keeps the previous mapping alive
+// as long as any `View` (or `Snapshot`, `Pinned`) still refers to it, since
+// `Rcu<T>` destroys a previous `shared_ptr` only after all `View`s have
+// advanced past it.
+//
+// The file must not be modified while it's mapped. Publish new versions as
+// new files, for example by writing a temporary file and renaming it over the
+// old one, which doesn't affect existing mappings.
+//
+// Thread-safe.
+class MappedFile final {
+ public:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+#ifdef _SIMPLE_RCU_HAS_MMAP
+    if (size_ > 0) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+  }
+
+  // Maps the whole file at `path`. An empty file results in an empty
+  // instance.
+  static absl::StatusOr<std::unique_ptr<const MappedFile>> Open(
+      const std::string &path) {
+#ifdef _SIMPLE_RCU_HAS_MMAP
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return absl::ErrnoToStatus(errno, "open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      const int error = errno;
+      close(fd);
+      return absl::ErrnoToStatus(error, "fstat " + path);
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *data = nullptr;
+    if (size > 0) {
+      data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        const int error = errno;
+        close(fd);
+        return absl::ErrnoToStatus(error, "mmap " + path);
+      }
+    }
+    // The mapping remains valid after closing the descriptor.
+    close(fd);
+    return std::unique_ptr<const MappedFile>(
+        new MappedFile(static_cast<const char *>(data), size));
+#else
+    return absl::UnimplementedError("Memory-mapped files aren't supported");
+#endif
+  }
+
+  const char *data() const noexcept { return data_; }
+  size_t size() const noexcept { return size_; }
+  absl::string_view contents() const noexcept {
+    return absl::string_view(data_, size_);
+  }
+
+  // Returns a pointer to `count` consecutive objects of type `U` at byte
+  // `offset` of the file, or `nullptr` if they'd extend past its end or if
+  // `offset` isn't suitably aligned for `U`. `U` must be trivially copyable
+  // with a layout that doesn't depend on the process, such as fixed-width
+  // integers and structs of them.
+  template <typename U>
+  const U *At(size_t offset, size_t count = 1) const noexcept {
+    if (offset > size_ || count > (size_ - offset) / sizeof(U) ||
+        (reinterpret_cast<uintptr_t>(data_) + offset) % alignof(U) != 0) {
+      return nullptr;
+    }
+    return reinterpret_cast<const U *>(data_ + offset);
+  }
+
+ private:
+  MappedFile(const char *data, size_t size) : data_(data), size_(size) {}
+
+  // Page-aligned, or `nullptr` if `size_` is 0.
+  const char *const data_;
+  const size_t size_;
+};
+
+// Maps the file at `path` and makes it the new value of `rcu`. The previous
+// file is unmapped once no reader refers to it any more.
+//
+// Thread-safe.
+template <typename Policy>
+absl::Status UpdateFromFile(Rcu<MappedFile, Policy> &rcu,
+                            const std::string &path) {
+  absl::StatusOr<std::unique_ptr<const MappedFile>> file =
+      MappedFile::Open(path);
+  if (!file.ok()) {
+    return file.status();
+  }
+  rcu.Update(std::move(*file));
+  return absl::OkStatus();
+}
+
+}  // namespace simple_rcu
+
+#undef _SIMPLE_RCU_HAS_MMAP
+
+#endif  // _SIMPLE_RCU_MAPPED_FILE_H
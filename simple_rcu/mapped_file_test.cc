@@ -0,0 +1,122 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/mapped_file.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "gtest/gtest.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// A flat layout of a table of integers: A header followed by `count` values.
+struct Header {
+  uint32_t count;
+  uint32_t reserved;
+};
+
+std::string TablePath(const std::string &name) {
+  return testing::TempDir() + "/mapped_file_test_" + name;
+}
+
+void WriteTable(const std::string &path,
+                std::initializer_list<uint32_t> values) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  ASSERT_NE(file, nullptr) << path;
+  const Header header{static_cast<uint32_t>(values.size()), 0};
+  std::fwrite(&header, sizeof(header), 1, file);
+  for (uint32_t value : values) {
+    std::fwrite(&value, sizeof(value), 1, file);
+  }
+  ASSERT_EQ(std::fclose(file), 0);
+}
+
+TEST(MappedFileTest, ReadsInPlace) {
+  const std::string path = TablePath("reads_in_place");
+  WriteTable(path, {7, 8, 9});
+  auto file = MappedFile::Open(path);
+  ASSERT_TRUE(file.ok()) << file.status();
+  const MappedFile &mapped = **file;
+  EXPECT_EQ(mapped.size(), sizeof(Header) + 3 * sizeof(uint32_t));
+  const Header *header = mapped.At<Header>(0);
+  ASSERT_NE(header, nullptr);
+  ASSERT_EQ(header->count, 3u);
+  const uint32_t *values = mapped.At<uint32_t>(sizeof(Header), header->count);
+  ASSERT_NE(values, nullptr);
+  EXPECT_EQ(values[0], 7u);
+  EXPECT_EQ(values[2], 9u);
+  EXPECT_EQ(values, reinterpret_cast<const uint32_t *>(mapped.data() +
+                                                       sizeof(Header)))
+      << "Must point into the mapping without copying";
+  EXPECT_EQ(mapped.At<uint32_t>(sizeof(Header), 4), nullptr)
+      << "Must reject a range past the end";
+  EXPECT_EQ(mapped.At<uint32_t>(mapped.size() + 4), nullptr);
+  EXPECT_EQ(mapped.At<uint32_t>(1), nullptr) << "Must reject misalignment";
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileTest, EmptyFile) {
+  const std::string path = TablePath("empty");
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(std::fclose(file), 0);
+  auto mapped = MappedFile::Open(path);
+  ASSERT_TRUE(mapped.ok()) << mapped.status();
+  EXPECT_EQ((*mapped)->size(), 0u);
+  EXPECT_TRUE((*mapped)->contents().empty());
+  EXPECT_EQ((*mapped)->At<uint32_t>(0), nullptr);
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileTest, MissingFile) {
+  auto mapped = MappedFile::Open(TablePath("missing"));
+  EXPECT_TRUE(absl::IsNotFound(mapped.status())) << mapped.status();
+}
+
+TEST(MappedFileTest, UpdateFromFileKeepsOldSnapshots) {
+  const std::string first = TablePath("first");
+  const std::string second = TablePath("second");
+  WriteTable(first, {1});
+  WriteTable(second, {2, 3});
+  Rcu<MappedFile> rcu;
+  Rcu<MappedFile>::View local(rcu);
+  ASSERT_TRUE(UpdateFromFile(rcu, first).ok());
+  std::shared_ptr<const MappedFile> pinned = *local.Read();
+  ASSERT_NE(pinned, nullptr);
+  ASSERT_TRUE(UpdateFromFile(rcu, second).ok());
+  // Files can be removed while mapped.
+  std::remove(first.c_str());
+  std::remove(second.c_str());
+  {
+    auto snapshot = local.Read();
+    ASSERT_NE(*snapshot, nullptr);
+    EXPECT_EQ((*snapshot)->At<Header>(0)->count, 2u);
+  }
+  EXPECT_EQ(pinned->At<Header>(0)->count, 1u)
+      << "The old mapping must stay valid while referenced";
+  EXPECT_EQ(*pinned->At<uint32_t>(sizeof(Header)), 1u);
+  EXPECT_FALSE(UpdateFromFile(rcu, first).ok());
+  EXPECT_EQ((*local.Read())->At<Header>(0)->count, 2u)
+      << "A failed update must keep the current value";
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,272 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_NUMA_RCU_H
+#define _SIMPLE_RCU_NUMA_RCU_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+
+// The NUMA nodes of the machine and the CPUs that belong to each of them.
+// Nodes are numbered densely from 0, even if the system numbers them
+// sparsely.
+//
+// If the topology can't be determined, there is a single node 0 with no
+// known CPUs, to which all CPUs belong.
+class NumaTopology {
+ public:
+  // Constructs a topology where `node_cpus[i]` are the CPUs of node `i`.
+  // Mainly for testing.
+  explicit NumaTopology(std::vector<std::vector<int>> node_cpus)
+      : node_cpus_(std::move(node_cpus)), cpu_nodes_() {
+    if (node_cpus_.empty()) {
+      node_cpus_.emplace_back();
+    }
+    for (size_t node = 0; node < node_cpus_.size(); node++) {
+      for (int cpu : node_cpus_[node]) {
+        if (cpu >= static_cast<int>(cpu_nodes_.size())) {
+          cpu_nodes_.resize(cpu + 1, 0);
+        }
+        cpu_nodes_[cpu] = node;
+      }
+    }
+  }
+
+  // The topology of this machine, read once from
+  // `/sys/devices/system/node` on Linux.
+  static const NumaTopology &System() {
+    static const NumaTopology *const topology = new NumaTopology(ReadSystem());
+    return *topology;
+  }
+
+  size_t nodes() const noexcept { return node_cpus_.size(); }
+  const std::vector<int> &cpus(size_t node) const noexcept {
+    return node_cpus_[node];
+  }
+
+  // The node of `cpu`, or 0 if unknown.
+  size_t NodeOfCpu(int cpu) const noexcept {
+    return (cpu >= 0 && cpu < static_cast<int>(cpu_nodes_.size()))
+               ? cpu_nodes_[cpu]
+               : 0;
+  }
+
+  // The node of the CPU the calling thread is running on right now. Unless
+  // the thread is pinned, it can be migrated to another node at any time.
+  size_t CurrentNode() const noexcept {
+#ifdef __linux__
+    return NodeOfCpu(sched_getcpu());
+#else
+    return 0;
+#endif
+  }
+
+  // Runs `f` on the calling thread, temporarily restricted to the CPUs of
+  // `node`. So memory first touched by `f` is usually allocated on `node`.
+  // If that isn't possible, just runs `f`.
+  void RunOnNode(size_t node, absl::FunctionRef<void()> f) const {
+#ifdef __linux__
+    if (nodes() > 1 && !node_cpus_[node].empty()) {
+      cpu_set_t previous;
+      if (pthread_getaffinity_np(pthread_self(), sizeof(previous),
+                                 &previous) == 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        // CPUs beyond the fixed-size `cpu_set_t` can't be set, so `f` runs
+        // just on the remaining ones (if any) of `node`.
+        for (int cpu : node_cpus_[node]) {
+          if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpus);
+          }
+        }
+        const bool moved =
+            CPU_COUNT(&cpus) > 0 &&
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+        f();
+        if (moved) {
+          pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+        }
+        return;
+      }
+    }
+#endif
+    f();
+  }
+
+  // Parses a list in the format of `/sys/devices/system/node/*/cpulist`,
+  // such as "0-3,8,10-11". Stops at the first malformed element.
+  static std::vector<int> ParseList(const std::string &list) {
+    std::vector<int> result;
+    const char *p = list.c_str();
+    while (*p != '\0' && *p != '\n') {
+      char *end;
+      const long first = std::strtol(p, &end, 10);
+      if (end == p || first < 0) {
+        break;
+      }
+      long last = first;
+      p = end;
+      if (*p == '-') {
+        last = std::strtol(p + 1, &end, 10);
+        if (end == p + 1 || last < first) {
+          break;
+        }
+        p = end;
+      }
+      for (long i = first; i <= last; i++) {
+        result.push_back(static_cast<int>(i));
+      }
+      if (*p == ',') {
+        p++;
+      }
+    }
+    return result;
+  }
+
+ private:
+  static std::vector<std::vector<int>> ReadSystem() {
+    std::vector<std::vector<int>> node_cpus;
+#ifdef __linux__
+    const std::string base = "/sys/devices/system/node/";
+    for (int node : ParseList(ReadFile(base + "online"))) {
+      node_cpus.push_back(
+          ParseList(ReadFile(base + "node" + std::to_string(node) +
+                             "/cpulist")));
+    }
+#endif
+    return node_cpus;
+  }
+
+  static std::string ReadFile(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+  }
+
+  std::vector<std::vector<int>> node_cpus_;
+  // Maps CPUs to indices of `node_cpus_`.
+  std::vector<size_t> cpu_nodes_;
+};
+
+// Variant of `Rcu<T>` for machines with multiple NUMA nodes. It keeps a
+// separate replica of each value on each node, and every `View` reads the
+// replica of the node it has been constructed on. This avoids remote memory
+// accesses by readers on other nodes than the updater's, at the cost of
+// keeping one instance of `T` per node.
+//
+// Each replica is constructed (and later destroyed) by the updating thread
+// while it's temporarily restricted to the CPUs of the replica's node, so
+// that it's allocated there under the usual first-touch policy. Values are
+// distributed to `View`s of each node in turn, so `View`s of different nodes
+// may briefly observe different values. `View`s of a single node observe the
+// same sequence of values as with `Rcu<T>`.
+//
+// Reader threads are expected to be pinned to a node (or to stay within it).
+// A `View` keeps reading the replica of the node it was constructed on even
+// if its thread migrates elsewhere.
+template <typename T>
+class NumaRcu {
+ public:
+  using Snapshot = typename Rcu<T>::template SnapshotPtr<const T>;
+
+  // Interface to the RCU local to a particular reader thread, see
+  // `CopyRcu::View`.
+  class View final {
+   public:
+    // Thread-safe. Argument `rcu` must outlive this instance.
+    // Binds to the replica of the node the calling thread currently runs on.
+    explicit View(NumaRcu &rcu) : View(rcu, rcu.topology_.CurrentNode()) {}
+    // Binds to the replica of a given `node`.
+    View(NumaRcu &rcu, size_t node)
+        : node_(node < rcu.nodes_.size() ? node : 0),
+          view_(*rcu.nodes_[node_]) {}
+
+    // Obtains a read snapshot to the current value of the replica of this
+    // `View`'s node. See `CopyRcu::View::ReadPtr()`.
+    Snapshot ReadPtr() noexcept { return view_.ReadPtr(); }
+
+    size_t node() const noexcept { return node_; }
+
+   private:
+    const size_t node_;
+    typename Rcu<T>::View view_;
+  };
+
+  // Constructs a RCU with a copy of `initial_value` on each node of
+  // `topology`.
+  explicit NumaRcu(const T &initial_value,
+                   const NumaTopology &topology = NumaTopology::System())
+      : topology_(topology), lock_(), nodes_() {
+    for (size_t node = 0; node < topology_.nodes(); node++) {
+      nodes_.push_back(absl::make_unique<Rcu<T>>());
+    }
+    Update(initial_value);
+  }
+  NumaRcu(const NumaRcu &) = delete;
+  NumaRcu &operator=(const NumaRcu &) = delete;
+
+  // Distributes a copy of `value` to all `View`s of each node.
+  //
+  // Thread-safe.
+  void Update(const T &value) ABSL_LOCKS_EXCLUDED(lock_) {
+    UpdateFrom([&value]() { return absl::make_unique<const T>(value); });
+  }
+  // Like `Update`, but constructs the replica for each node by calling
+  // `make`, which must return an equal value each time. Useful for values
+  // with internal pointers, which should point to memory on the same node.
+  //
+  // Thread-safe.
+  void UpdateFrom(absl::FunctionRef<std::unique_ptr<const T>()> make)
+      ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    for (size_t node = 0; node < nodes_.size(); node++) {
+      topology_.RunOnNode(node, [this, node, make]() {
+        // The previous replica is also destroyed on its node.
+        nodes_[node]->Update(std::shared_ptr<const T>(make()));
+      });
+    }
+  }
+
+  size_t nodes() const noexcept { return nodes_.size(); }
+
+ private:
+  const NumaTopology topology_;
+  // Serializes updates so that all nodes receive them in the same order.
+  absl::Mutex lock_;
+  // One per node. Never modified after construction.
+  std::vector<std::unique_ptr<Rcu<T>>> nodes_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_NUMA_RCU_H
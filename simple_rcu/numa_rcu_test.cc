@@ -0,0 +1,92 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/numa_rcu.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::Pointee;
+
+TEST(NumaTopologyTest, ParseList) {
+  EXPECT_THAT(NumaTopology::ParseList("0"), ElementsAre(0));
+  EXPECT_THAT(NumaTopology::ParseList("0-3,8,10-11\n"),
+              ElementsAre(0, 1, 2, 3, 8, 10, 11));
+  EXPECT_THAT(NumaTopology::ParseList(""), IsEmpty());
+  EXPECT_THAT(NumaTopology::ParseList("2,x"), ElementsAre(2));
+}
+
+TEST(NumaTopologyTest, NodeOfCpu) {
+  NumaTopology topology({{0, 1}, {2, 3}});
+  EXPECT_EQ(topology.nodes(), 2u);
+  EXPECT_EQ(topology.NodeOfCpu(1), 0u);
+  EXPECT_EQ(topology.NodeOfCpu(2), 1u);
+  EXPECT_EQ(topology.NodeOfCpu(42), 0u) << "Unknown CPUs must map to node 0";
+  EXPECT_EQ(NumaTopology({}).nodes(), 1u);
+}
+
+TEST(NumaTopologyTest, System) {
+  const NumaTopology &topology = NumaTopology::System();
+  ASSERT_GE(topology.nodes(), 1u);
+  EXPECT_LT(topology.CurrentNode(), topology.nodes());
+  bool ran = false;
+  topology.RunOnNode(topology.nodes() - 1, [&ran]() { ran = true; });
+  EXPECT_TRUE(ran);
+}
+
+TEST(NumaRcuTest, UpdateAndRead) {
+  NumaRcu<std::string> rcu("foo");
+  NumaRcu<std::string>::View local(rcu);
+  EXPECT_THAT(local.ReadPtr(), Pointee(std::string("foo")));
+  rcu.Update("bar");
+  EXPECT_THAT(local.ReadPtr(), Pointee(std::string("bar")));
+}
+
+TEST(NumaRcuTest, ReplicaPerNode) {
+  // All CPUs of this machine belong to node 1 of the simulated topology.
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < 1024; cpu++) {
+    cpus.push_back(cpu);
+  }
+  NumaRcu<int> rcu(0, NumaTopology({{}, cpus}));
+  ASSERT_EQ(rcu.nodes(), 2u);
+  NumaRcu<int>::View current(rcu);
+  NumaRcu<int>::View other(rcu, 0);
+  EXPECT_EQ(current.node(), 1u);
+  EXPECT_EQ(other.node(), 0u);
+  int made = 0;
+  rcu.UpdateFrom([&made]() {
+    made++;
+    return absl::make_unique<const int>(42);
+  });
+  EXPECT_EQ(made, 2) << "Each node must get its own replica";
+  auto snapshot = current.ReadPtr();
+  EXPECT_THAT(snapshot, Pointee(42));
+  EXPECT_THAT(other.ReadPtr(), Pointee(42));
+  EXPECT_NE(snapshot.get(), other.ReadPtr().get())
+      << "Views on different nodes must read different replicas";
+}
+
+}  // namespace
+}  // namespace simple_rcu
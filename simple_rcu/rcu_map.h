@@ -0,0 +1,354 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_RCU_MAP_H
+#define _SIMPLE_RCU_RCU_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/hash/hash.h"
+#include "absl/numeric/bits.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/copy_rcu.h"
+
+namespace simple_rcu {
+
+// Concurrent, read-mostly hash map from `K` to `V`.
+//
+// The contents are an immutable `Table`, a hash array mapped trie (HAMT) of
+// nodes shared between successive versions. Each write copies only the path
+// from the root to the affected entry, that is, O(log n) nodes of at most 32
+// pointers each, and publishes the new root through a `CopyRcu<Table>`. So
+// writes cost O(log n) time and memory instead of rebuilding the whole map,
+// and readers keep most of the table warm in their caches across updates.
+//
+// Reading is `CopyRcu::View::Read()` and a lookup that follows one pointer
+// per level of the trie. Readers never allocate or lock anything.
+//
+// `Hash` and `Eq` are default-constructed when needed.
+template <typename K, typename V, typename Hash = absl::Hash<K>,
+          typename Eq = std::equal_to<K>>
+class RcuMap {
+ private:
+  struct Node;
+  using NodePtr = std::shared_ptr<const Node>;
+
+ public:
+  // An immutable version of the contents of a `RcuMap`.
+  class Table {
+   public:
+    Table() : root_(), size_(0) {}
+
+    // Returns the value of `key`, or `nullptr` if there is none. It's valid
+    // as long as this `Table`.
+    const V *Find(const K &key) const {
+      const size_t hash = Hash()(key);
+      const Node *node = root_.get();
+      for (int shift = 0; node != nullptr; shift += kBits) {
+        if (node->is_leaf) {
+          const Leaf &leaf = static_cast<const Leaf &>(*node);
+          if (leaf.hash == hash) {
+            for (const auto &entry : leaf.entries) {
+              if (Eq()(entry.first, key)) {
+                return &entry.second;
+              }
+            }
+          }
+          return nullptr;
+        }
+        const Branch &branch = static_cast<const Branch &>(*node);
+        const uint32_t bit = Bit(hash, shift);
+        if ((branch.bitmap & bit) == 0) {
+          return nullptr;
+        }
+        node = branch.children[Position(branch.bitmap, bit)].get();
+      }
+      return nullptr;
+    }
+    bool contains(const K &key) const { return Find(key) != nullptr; }
+
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    // Calls `f` for each entry, in an unspecified order.
+    void ForEach(absl::FunctionRef<void(const K &, const V &)> f) const {
+      if (root_ != nullptr) {
+        ForEachIn(*root_, f);
+      }
+    }
+
+   private:
+    Table(NodePtr root, size_t size) : root_(std::move(root)), size_(size) {}
+
+    static void ForEachIn(const Node &node,
+                          absl::FunctionRef<void(const K &, const V &)> f) {
+      if (node.is_leaf) {
+        for (const auto &entry : static_cast<const Leaf &>(node).entries) {
+          f(entry.first, entry.second);
+        }
+      } else {
+        const Branch &branch = static_cast<const Branch &>(node);
+        for (const NodePtr &child : branch.children) {
+          ForEachIn(*child, f);
+        }
+      }
+    }
+
+    // `nullptr` if the table is empty.
+    NodePtr root_;
+    size_t size_;
+
+    friend class RcuMap;
+  };
+
+  using Snapshot = typename CopyRcu<Table>::Snapshot;
+
+  // Interface to the map local to a particular reader thread, see
+  // `CopyRcu::View`.
+  class View final {
+   public:
+    // Thread-safe. Argument `map` must outlive this instance.
+    explicit View(RcuMap &map) : view_(map.rcu_) {}
+
+    // Obtains a read snapshot of the current contents. See
+    // `CopyRcu::View::Read()`.
+    Snapshot Read() noexcept { return view_.Read(); }
+
+    // Shorthand for `Read()->Find(key)` that copies the value, if any, so
+    // that it doesn't need to be used within the scope of a `Snapshot`.
+    bool Get(const K &key, V &value) {
+      const Snapshot snapshot = Read();
+      const V *found = snapshot->Find(key);
+      if (found == nullptr) {
+        return false;
+      }
+      value = *found;
+      return true;
+    }
+
+   private:
+    typename CopyRcu<Table>::View view_;
+  };
+
+  RcuMap() : lock_(), table_(), rcu_(table_) {}
+  RcuMap(const RcuMap &) = delete;
+  RcuMap &operator=(const RcuMap &) = delete;
+
+  // Sets the value of `key`. Returns `true` if `key` wasn't present before.
+  //
+  // Thread-safe.
+  bool InsertOrAssign(const K &key, V value) ABSL_LOCKS_EXCLUDED(lock_) {
+    const size_t hash = Hash()(key);
+    absl::MutexLock lock(&lock_);
+    bool inserted = false;
+    NodePtr root =
+        Insert(table_.root_, 0, hash, key, std::move(value), inserted);
+    Publish(Table(std::move(root), table_.size_ + inserted));
+    return inserted;
+  }
+
+  // Removes `key`. Returns `true` if it was present.
+  //
+  // Thread-safe.
+  bool Erase(const K &key) ABSL_LOCKS_EXCLUDED(lock_) {
+    const size_t hash = Hash()(key);
+    absl::MutexLock lock(&lock_);
+    bool erased = false;
+    NodePtr root = Remove(table_.root_, 0, hash, key, erased);
+    if (erased) {
+      Publish(Table(std::move(root), table_.size_ - 1));
+    }
+    return erased;
+  }
+
+  // Removes all entries.
+  //
+  // Thread-safe.
+  void Clear() ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    Publish(Table());
+  }
+
+  // The current contents, as seen by writers.
+  //
+  // Thread-safe.
+  Table Get() const ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    return table_;
+  }
+
+ private:
+  // Each level of the trie consumes this many bits of the hash.
+  static constexpr int kBits = 5;
+
+  struct Node {
+    explicit Node(bool is_leaf) : is_leaf(is_leaf) {}
+
+    const bool is_leaf;
+  };
+  // All entries whose keys have the same `hash`.
+  struct Leaf : public Node {
+    explicit Leaf(size_t hash) : Node(true), hash(hash), entries() {}
+
+    const size_t hash;
+    std::vector<std::pair<K, V>> entries;
+  };
+  // Children of a node, one per each bit set in `bitmap`, in the order of the
+  // bits. The bits are given by the next `kBits` bits of the hash.
+  struct Branch : public Node {
+    Branch() : Node(false), bitmap(0), children() {}
+
+    uint32_t bitmap;
+    std::vector<NodePtr> children;
+  };
+
+  static uint32_t Bit(size_t hash, int shift) noexcept {
+    return uint32_t{1} << ((hash >> shift) & ((1u << kBits) - 1));
+  }
+  static size_t Position(uint32_t bitmap, uint32_t bit) noexcept {
+    return absl::popcount(bitmap & (bit - 1));
+  }
+
+  // Returns a copy of the sub-trie `node` at `shift` with `key` set to
+  // `value`. Sets `inserted` if `key` wasn't present.
+  //
+  // Two leaves with different hashes differ at some bit, so the recursion
+  // ends before `shift` exceeds the bits of `size_t`.
+  static NodePtr Insert(const NodePtr &node, int shift, size_t hash,
+                        const K &key, V value, bool &inserted) {
+    if (node == nullptr) {
+      auto leaf = std::make_shared<Leaf>(hash);
+      leaf->entries.emplace_back(key, std::move(value));
+      inserted = true;
+      return leaf;
+    }
+    if (node->is_leaf) {
+      const Leaf &leaf = static_cast<const Leaf &>(*node);
+      if (leaf.hash == hash) {
+        auto copy = std::make_shared<Leaf>(leaf);
+        for (auto &entry : copy->entries) {
+          if (Eq()(entry.first, key)) {
+            entry.second = std::move(value);
+            return copy;
+          }
+        }
+        copy->entries.emplace_back(key, std::move(value));
+        inserted = true;
+        return copy;
+      }
+      // Move `leaf` one level down and continue there.
+      Branch branch;
+      branch.bitmap = Bit(leaf.hash, shift);
+      branch.children.push_back(node);
+      return InsertInto(branch, shift, hash, key, std::move(value), inserted);
+    }
+    return InsertInto(static_cast<const Branch &>(*node), shift, hash, key,
+                      std::move(value), inserted);
+  }
+
+  static NodePtr InsertInto(const Branch &branch, int shift, size_t hash,
+                            const K &key, V value, bool &inserted) {
+    const uint32_t bit = Bit(hash, shift);
+    const size_t position = Position(branch.bitmap, bit);
+    auto copy = std::make_shared<Branch>(branch);
+    if ((copy->bitmap & bit) != 0) {
+      copy->children[position] = Insert(copy->children[position],
+                                        shift + kBits, hash, key,
+                                        std::move(value), inserted);
+    } else {
+      copy->bitmap |= bit;
+      copy->children.insert(
+          copy->children.begin() + position,
+          Insert(nullptr, shift + kBits, hash, key, std::move(value),
+                 inserted));
+    }
+    return copy;
+  }
+
+  // Returns a copy of the sub-trie `node` at `shift` without `key`, or
+  // `nullptr` if it'd be empty. If `key` isn't present, returns `node` and
+  // leaves `erased` unchanged.
+  static NodePtr Remove(const NodePtr &node, int shift, size_t hash,
+                        const K &key, bool &erased) {
+    if (node == nullptr) {
+      return node;
+    }
+    if (node->is_leaf) {
+      const Leaf &leaf = static_cast<const Leaf &>(*node);
+      if (leaf.hash != hash) {
+        return node;
+      }
+      for (size_t i = 0; i < leaf.entries.size(); i++) {
+        if (Eq()(leaf.entries[i].first, key)) {
+          erased = true;
+          if (leaf.entries.size() == 1) {
+            return nullptr;
+          }
+          auto copy = std::make_shared<Leaf>(leaf);
+          copy->entries.erase(copy->entries.begin() + i);
+          return copy;
+        }
+      }
+      return node;
+    }
+    const Branch &branch = static_cast<const Branch &>(*node);
+    const uint32_t bit = Bit(hash, shift);
+    if ((branch.bitmap & bit) == 0) {
+      return node;
+    }
+    const size_t position = Position(branch.bitmap, bit);
+    NodePtr child =
+        Remove(branch.children[position], shift + kBits, hash, key, erased);
+    if (!erased) {
+      return node;
+    }
+    if (child == nullptr && branch.children.size() == 1) {
+      return nullptr;
+    }
+    auto copy = std::make_shared<Branch>(branch);
+    if (child == nullptr) {
+      copy->bitmap &= ~bit;
+      copy->children.erase(copy->children.begin() + position);
+    } else {
+      copy->children[position] = std::move(child);
+    }
+    // A single remaining leaf can replace the branch, since lookups compare
+    // the whole hash of a leaf.
+    if (copy->children.size() == 1 && copy->children[0]->is_leaf) {
+      return copy->children[0];
+    }
+    return copy;
+  }
+
+  void Publish(Table table) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    table_ = table;
+    rcu_.Update(std::move(table));
+  }
+
+  // Serializes writers, which derive each new version from `table_`.
+  mutable absl::Mutex lock_;
+  Table table_ ABSL_GUARDED_BY(lock_);
+  CopyRcu<Table> rcu_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_RCU_MAP_H
@@ -0,0 +1,160 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/rcu_map.h"
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::Pointee;
+
+TEST(RcuMapTest, InsertFindErase) {
+  RcuMap<std::string, int> map;
+  RcuMap<std::string, int>::View view(map);
+  EXPECT_TRUE(view.Read()->empty());
+  EXPECT_TRUE(map.InsertOrAssign("a", 1));
+  EXPECT_TRUE(map.InsertOrAssign("b", 2));
+  EXPECT_FALSE(map.InsertOrAssign("a", 3)) << "Must assign an existing key";
+  {
+    auto snapshot = view.Read();
+    EXPECT_EQ(snapshot->size(), 2u);
+    EXPECT_THAT(snapshot->Find("a"), Pointee(3));
+    EXPECT_THAT(snapshot->Find("b"), Pointee(2));
+    EXPECT_EQ(snapshot->Find("c"), nullptr);
+  }
+  EXPECT_TRUE(map.Erase("a"));
+  EXPECT_FALSE(map.Erase("a"));
+  int value = 0;
+  EXPECT_FALSE(view.Get("a", value));
+  EXPECT_TRUE(view.Get("b", value));
+  EXPECT_EQ(value, 2);
+  map.Clear();
+  EXPECT_TRUE(view.Read()->empty());
+  EXPECT_TRUE(map.Get().empty());
+}
+
+TEST(RcuMapTest, SnapshotIsUnaffectedByWrites) {
+  RcuMap<int, int> map;
+  map.InsertOrAssign(1, 1);
+  const RcuMap<int, int>::Table before = map.Get();
+  map.InsertOrAssign(1, 2);
+  map.InsertOrAssign(2, 2);
+  EXPECT_THAT(before.Find(1), Pointee(1));
+  EXPECT_FALSE(before.contains(2));
+  EXPECT_THAT(map.Get().Find(1), Pointee(2));
+}
+
+// Maps all keys to the same hash, so that they all end up in a single leaf.
+struct CollidingHash {
+  size_t operator()(int) const { return 42; }
+};
+
+TEST(RcuMapTest, HashCollisions) {
+  RcuMap<int, int, CollidingHash> map;
+  for (int i = 0; i < 10; i++) {
+    map.InsertOrAssign(i, i * i);
+  }
+  for (int i = 0; i < 10; i += 2) {
+    EXPECT_TRUE(map.Erase(i));
+  }
+  const auto table = map.Get();
+  EXPECT_EQ(table.size(), 5u);
+  for (int i = 0; i < 10; i++) {
+    if (i % 2 == 0) {
+      EXPECT_EQ(table.Find(i), nullptr);
+    } else {
+      EXPECT_THAT(table.Find(i), Pointee(i * i));
+    }
+  }
+}
+
+// Keeps only the lowest bits of keys, so that keys that share them share
+// a path of the trie down to the last levels, and collide there.
+struct ShortHash {
+  size_t operator()(int key) const { return key & 0xfff; }
+};
+
+template <typename Hash>
+void CompareWithStdMap() {
+  RcuMap<int, int, Hash> map;
+  std::map<int, int> expected;
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int> keys(0, 1 << 14);
+  for (int i = 0; i < 20000; i++) {
+    const int key = keys(random);
+    if (random() % 3 == 0) {
+      EXPECT_EQ(map.Erase(key), expected.erase(key) == 1);
+    } else {
+      EXPECT_EQ(map.InsertOrAssign(key, i), expected.count(key) == 0);
+      expected[key] = i;
+    }
+  }
+  const auto table = map.Get();
+  ASSERT_EQ(table.size(), expected.size());
+  for (int key = 0; key <= 1 << 14; key++) {
+    const auto it = expected.find(key);
+    if (it == expected.end()) {
+      EXPECT_EQ(table.Find(key), nullptr) << key;
+    } else {
+      EXPECT_THAT(table.Find(key), Pointee(it->second)) << key;
+    }
+  }
+  std::map<int, int> visited;
+  table.ForEach([&visited](const int &key, const int &value) {
+    EXPECT_TRUE(visited.emplace(key, value).second);
+  });
+  EXPECT_EQ(visited, expected);
+}
+
+TEST(RcuMapTest, CompareWithStdMap) { CompareWithStdMap<absl::Hash<int>>(); }
+
+TEST(RcuMapTest, CompareWithStdMapShortHash) {
+  CompareWithStdMap<ShortHash>();
+}
+
+TEST(RcuMapTest, ConcurrentReadsAndWrites) {
+  static constexpr int kKeys = 1000;
+  RcuMap<int, int> map;
+  std::atomic<bool> done(false);
+  std::thread reader([&map, &done]() {
+    RcuMap<int, int>::View view(map);
+    while (!done.load()) {
+      auto snapshot = view.Read();
+      // Keys are inserted in order, each with its own value.
+      for (int key = 0; key < static_cast<int>(snapshot->size()); key++) {
+        ASSERT_THAT(snapshot->Find(key), Pointee(key));
+      }
+    }
+  });
+  for (int key = 0; key < kKeys; key++) {
+    map.InsertOrAssign(key, key);
+  }
+  done.store(true);
+  reader.join();
+  RcuMap<int, int>::View view(map);
+  EXPECT_EQ(view.Read()->size(), static_cast<size_t>(kKeys));
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,178 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_RCU_STATS_H
+#define _SIMPLE_RCU_RCU_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace simple_rcu {
+
+// Statistics of a `CopyRcu` or `ReverseRcu` instance, as returned by their
+// `Stats()` method. All counters are totals since the instance was
+// constructed, including `View` instances that have been destroyed since.
+//
+// For `ReverseRcu` the roles are reversed: "reads" are `Write()` snapshots
+// and "updates" are `Collect()` calls.
+struct RcuStats {
+  // `View` instances currently registered.
+  uint_fast64_t views;
+  // Outermost `Read()` calls, that is, those that attempted to advance to a
+  // new value.
+  uint_fast64_t reads;
+  // Of `reads`, how many actually found a new value.
+  uint_fast64_t reads_with_new_value;
+  // Distributions of values to all `View` instances (including those by
+  // `Update`, `UpdateWith` etc.).
+  uint_fast64_t updates;
+  // Values passed to individual `View` instances by `updates`.
+  uint_fast64_t pushes;
+  // Of `pushes`, how many replaced a value that its `View` never read. A high
+  // ratio suggests that updates are more frequent than reads, or that many
+  // `View`s are idle. For `ReverseRcu` these are `View`s that haven't written
+  // anything since the previous `Collect()`.
+  uint_fast64_t pushes_unread;
+  // Total and maximum time spent by `updates` distributing values while
+  // holding the internal update lock.
+  uint_fast64_t update_nanos;
+  uint_fast64_t max_update_nanos;
+};
+
+// Policies for the `StatsPolicy` template parameter of `CopyRcu` and
+// `ReverseRcu`.
+//
+// Collects no statistics, at no cost. `Stats()` reports just `views`.
+struct NoStats {
+  class Reader {
+   public:
+    void RecordRead(bool) noexcept {}
+    void AddTo(RcuStats &) const noexcept {}
+  };
+
+  class Updater {
+   public:
+    void Start() noexcept {}
+    void Finish(size_t, size_t) noexcept {}
+    void Retire(const Reader &) noexcept {}
+    void AddTo(RcuStats &) const noexcept {}
+  };
+};
+
+// Collects all `RcuStats`.
+//
+// Each `View` keeps its own counters, written only by its reader thread
+// without any read-modify-write operations, so reading remains contention-free
+// and costs just a few more plain memory accesses. `Stats()` then sums the
+// counters of all `View`s, similarly to `ReverseRcu::Collect`, but without
+// interrupting the readers. Each update additionally reads a clock twice.
+struct WithStats {
+  // A counter with a single writer at a time and any number of concurrent
+  // readers.
+  class Counter {
+   public:
+    Counter() : value_(0) {}
+
+    void Add(uint_fast64_t delta) noexcept {
+      value_.store(value_.load(std::memory_order_relaxed) + delta,
+                   std::memory_order_relaxed);
+    }
+    void Max(uint_fast64_t value) noexcept {
+      if (value > value_.load(std::memory_order_relaxed)) {
+        value_.store(value, std::memory_order_relaxed);
+      }
+    }
+    uint_fast64_t Get() const noexcept {
+      return value_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<uint_fast64_t> value_;
+  };
+
+  // Counters of a single reader thread.
+  class Reader {
+   public:
+    void RecordRead(bool new_value) noexcept {
+      reads_.Add(1);
+      if (new_value) {
+        reads_with_new_value_.Add(1);
+      }
+    }
+    // Adds the counters of `other` to these ones, which must have no other
+    // writer meanwhile.
+    void Add(const Reader &other) noexcept {
+      reads_.Add(other.reads_.Get());
+      reads_with_new_value_.Add(other.reads_with_new_value_.Get());
+    }
+    void AddTo(RcuStats &stats) const noexcept {
+      stats.reads += reads_.Get();
+      stats.reads_with_new_value += reads_with_new_value_.Get();
+    }
+
+   private:
+    Counter reads_;
+    Counter reads_with_new_value_;
+  };
+
+  // Counters of updates. Methods other than `AddTo` must be called only under
+  // the update lock of the RCU.
+  class Updater {
+   public:
+    Updater() : start_() {}
+
+    // Called at the start of each update.
+    void Start() noexcept { start_ = std::chrono::steady_clock::now(); }
+    // Called at the end of each update that made `pushes` pushes, `unread`
+    // out of which overwrote a value that hadn't been read.
+    void Finish(size_t pushes, size_t unread) noexcept {
+      const uint_fast64_t nanos =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count();
+      updates_.Add(1);
+      pushes_.Add(pushes);
+      pushes_unread_.Add(unread);
+      update_nanos_.Add(nanos);
+      max_update_nanos_.Max(nanos);
+    }
+    // Keeps the counters of `reader` whose `View` has been destroyed.
+    void Retire(const Reader &reader) noexcept { retired_.Add(reader); }
+    void AddTo(RcuStats &stats) const noexcept {
+      retired_.AddTo(stats);
+      stats.updates += updates_.Get();
+      stats.pushes += pushes_.Get();
+      stats.pushes_unread += pushes_unread_.Get();
+      stats.update_nanos += update_nanos_.Get();
+      stats.max_update_nanos =
+          std::max(stats.max_update_nanos, max_update_nanos_.Get());
+    }
+
+   private:
+    std::chrono::steady_clock::time_point start_;
+    Counter updates_;
+    Counter pushes_;
+    Counter pushes_unread_;
+    Counter update_nanos_;
+    Counter max_update_nanos_;
+    Reader retired_;
+  };
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_RCU_STATS_H
@@ -15,16 +15,41 @@
 #ifndef _SIMPLE_RCU_REVERSE_RCU_H
 #define _SIMPLE_RCU_REVERSE_RCU_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
-#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
+#include "absl/meta/type_traits.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/utility/utility.h"
 #include "simple_rcu/local_3state_rcu.h"
+#include "simple_rcu/rcu_stats.h"
+#include "simple_rcu/tracing.h"
 
 namespace simple_rcu {
 
+// Resets a value of `ReverseRcu<T>` that has been collected to the empty state
+// `T()`, so that its buffer can be reused for further writes.
+//
+// By default calls `value.clear()` if `T` has such a method, which keeps the
+// allocated capacity of standard containers, and otherwise assigns `T()`.
+// Specialize it for types for which neither is suitable.
+template <typename T, typename = void>
+struct ResetTraits {
+  static void Reset(T& value) { value = T(); }
+};
+template <typename T>
+struct ResetTraits<T, absl::void_t<decltype(std::declval<T&>().clear())>> {
+  static void Reset(T& value) { value.clear(); }
+};
+
 // Class dual to `Rcu<T>`. The flow of information is reversed - from writers
 // ("readers") that actually store information and then it's collected from all
 // of them during the collect ("update") phase.
@@ -35,7 +60,14 @@ namespace simple_rcu {
 //
 // This is a low-level class, on top of which we can build a more user-friendly
 // interface for collecting metrics.
-template <typename T>
+//
+// Collected values are moved out of each `View`'s instance by `operator+=` and
+// the instance is then reset in place by `ResetTraits<T>` and returned to the
+// `View`. So with `Collect(T&)` neither writes nor collects allocate memory in
+// a steady state, if `operator+=` and `ResetTraits` keep capacity.
+//
+// `StatsPolicy` is either `NoStats` or `WithStats`, see `Stats()`.
+template <typename T, typename StatsPolicy = NoStats>
 class ReverseRcu {
  public:
   static_assert(std::is_default_constructible<T>::value,
@@ -60,12 +92,13 @@ class ReverseRcu {
 
     ~Snapshot() noexcept {
       if (--registrar_.snapshot_depth_ == 0) {
-        registrar_.local_rcu_.TryRead();
+        auto& local = *registrar_.local_;
+        local.RecordRead(local.local_rcu.TryRead());
       }
     }
 
     T* operator->() noexcept { return &**this; }
-    T& operator*() noexcept { return registrar_.local_rcu_.Read(); }
+    T& operator*() noexcept { return registrar_.local_->local_rcu.Read(); }
 
    private:
     Snapshot(View& registrar) noexcept : registrar_(registrar) {
@@ -83,19 +116,15 @@ class ReverseRcu {
   // separate `View` instance for each reader thread.
   class View final {
    public:
-    // Thread-safe.
-    View(ReverseRcu& rcu) ABSL_LOCKS_EXCLUDED(rcu.lock_)
-        : rcu_(rcu), snapshot_depth_(0), local_rcu_() {
-      // Allow `Snapshot` to `TryRead()` from the start.
-      local_rcu_.ForceUpdate();
-      absl::MutexLock mutex(&rcu_.lock_);
-      rcu_.threads_.insert(this);
-    }
-    ~View() ABSL_LOCKS_EXCLUDED(rcu_.lock_) {
-      absl::MutexLock mutex(&rcu_.lock_);
-      rcu_.value_ += Collect();
-      rcu_.threads_.erase(this);
-    }
+    // Thread-safe. The `View` may outlive `rcu`, in which case values written
+    // afterwards are just discarded.
+    // Registration acquires only a short-lived internal lock that is never
+    // held while `Collect` collects values from `View` instances, so it
+    // doesn't wait for a concurrently running `Collect`. Destruction doesn't
+    // acquire any lock at all. Values written to a destroyed `View` are
+    // collected by the next `Collect`.
+    View(ReverseRcu& rcu) : snapshot_depth_(0), local_(rcu.Register()) {}
+    ~View() { local_->abandoned.store(true, std::memory_order_release); }
 
     // Obtains a write snapshot to the local value to be collected by the RCU.
     // This is a very fast, lock-free and atomic operation.
@@ -103,24 +132,65 @@ class ReverseRcu {
     Snapshot Write() noexcept { return Snapshot(*this); }
 
    private:
-    // Thread-compatible.
-    T Collect() ABSL_EXCLUSIVE_LOCKS_REQUIRED(rcu_.lock_) {
-      local_rcu_.ForceUpdate();
-      return absl::exchange(local_rcu_.Update(), T());
-    }
+    // Holds a `Local3StateRcu<T>` shared by a `View` and the registry of its
+    // `ReverseRcu`. The `View` is the Reader, the thread holding
+    // `ReverseRcu::lock_` is the Updater.
+    //
+    // Inherits the counters of `StatsPolicy` written by the `View`, so that
+    // they take no space with `NoStats`.
+    struct Local : public StatsPolicy::Reader {
+      Local() : local_rcu(), abandoned(false) {
+        // Allow `Snapshot` to `TryRead()` from the start.
+        local_rcu.ForceUpdate();
+      }
+
+      Local3StateRcu<T> local_rcu;
+      // Set when the `View` is destroyed. Afterwards the Reader's value can
+      // be collected as well.
+      std::atomic<bool> abandoned;
+    };
 
-    ReverseRcu& rcu_;
     // Incremented with each `Snapshot` instance. Ensures that `TryRead` is
     // invoked only after the outermost `Snapshot` is destroyed, keeping
     // the reference unchanged for its whole lifetime.
     int_fast16_t snapshot_depth_;
-    Local3StateRcu<T> local_rcu_;
+    const std::shared_ptr<Local> local_;
 
     friend class ReverseRcu;
   };
 
+  // Configures collecting values from `View` instances in parallel. Useful
+  // when there are hundreds of them or more.
+  struct ShardedCollect {
+    // Runs `shard(i)` for each `i` in [0, `shards`), possibly in parallel,
+    // and returns after all of them have finished. See for example
+    // `FanOutPool::Executor()`.
+    using Executor =
+        std::function<void(size_t shards, absl::FunctionRef<void(size_t)>)>;
+
+    // The number of `View` instances combined into a single partial value by
+    // a `shard` call. If there are at most this many `View`s, they're
+    // collected directly by the calling thread.
+    size_t shard_size;
+    // If empty, all `View` instances are collected by the calling thread.
+    Executor executor;
+  };
+
   // Constructs a RCU with an initial value `T()`.
-  ReverseRcu() : lock_(), value_(), threads_() {}
+  ReverseRcu() : ReverseRcu(ShardedCollect{0, nullptr}) {}
+  // Constructs a RCU that collects values in parallel using `sharded`. Each
+  // shard combines its `View`s into a partial value, and these are then
+  // combined pairwise in parallel as well, in O(log(shards)) rounds. So
+  // `T::operator+=` must be safe to call concurrently on distinct values.
+  explicit ReverseRcu(ShardedCollect sharded)
+      : sharded_collect_(std::move(sharded)),
+        lock_(),
+        value_(),
+        collect_(),
+        partials_(),
+        registry_lock_(),
+        locals_(),
+        stats_() {}
 
   // Reads values from all registered `View` instances, including ones that
   // have been destroyed since the last call.
@@ -131,21 +201,162 @@ class ReverseRcu {
   // that have no `View` instance at all.
   //
   // Thread-safe.
-  T Collect() ABSL_LOCKS_EXCLUDED(lock_) {
+  T Collect() ABSL_LOCKS_EXCLUDED(lock_, registry_lock_) {
     absl::MutexLock mutex(&lock_);
-    for (View* thread : threads_) {
-      value_ += thread->Collect();
-    }
+    CollectLocked();
     return absl::exchange(value_, T());
   }
+  // Like `Collect()`, but stores the collected value into `result`, replacing
+  // its previous contents. The buffer of `result` is reset and kept for
+  // collecting the next value, so that calling this repeatedly with the same
+  // `result` doesn't allocate memory once buffers have grown large enough.
+  //
+  // Thread-safe.
+  void Collect(T& result) ABSL_LOCKS_EXCLUDED(lock_, registry_lock_) {
+    absl::MutexLock mutex(&lock_);
+    CollectLocked();
+    ResetTraits<T>::Reset(result);
+    using std::swap;
+    swap(result, value_);
+  }
+
+  // Returns statistics of this instance. Unless `StatsPolicy` is `WithStats`,
+  // only `views` is set and everything else is zero.
+  //
+  // Doesn't wait for a `Collect` in progress, nor does it interrupt writers.
+  // Counters recorded concurrently might not be included yet.
+  //
+  // Thread-safe.
+  RcuStats Stats() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    RcuStats stats{};
+    absl::MutexLock registry(&registry_lock_);
+    stats_.AddTo(stats);
+    for (const auto& local : locals_) {
+      if (!local->abandoned.load(std::memory_order_relaxed)) {
+        stats.views++;
+      }
+      local->AddTo(stats);
+    }
+    return stats;
+  }
 
  private:
+  using Local = typename View::Local;
+
+  // Adds values from all registered `View` instances to `value_`.
+  void CollectLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_)
+      ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    SIMPLE_RCU_TRACE(CollectBegin, this, 0);
+    stats_.Start();
+    // Instances abandoned by their `View`s. Destroyed only after releasing
+    // `registry_lock_`.
+    std::vector<std::shared_ptr<Local>> abandoned;
+    {
+      absl::MutexLock registry(&registry_lock_);
+      collect_.clear();
+      for (size_t i = 0; i < locals_.size();) {
+        if (locals_[i]->abandoned.load(std::memory_order_acquire)) {
+          stats_.Retire(*locals_[i]);
+          abandoned.push_back(std::move(locals_[i]));
+          locals_[i] = std::move(locals_.back());
+          locals_.pop_back();
+        } else {
+          collect_.push_back(locals_[i].get());
+          i++;
+        }
+      }
+    }
+    // The number of `View`s that haven't written anything since the previous
+    // call.
+    std::atomic<size_t> unread(0);
+    size_t serial_unread = 0;
+    for (const auto& local : abandoned) {
+      CollectFrom(*local, value_, serial_unread);
+      // There is no Reader any more.
+      value_ += std::move(local->local_rcu.Read());
+    }
+    // Instances are removed from `locals_` only above, therefore all pointers
+    // in `collect_` remain valid.
+    const size_t shard_size = sharded_collect_.shard_size;
+    if (sharded_collect_.executor && (collect_.size() > shard_size)) {
+      const size_t shards = (collect_.size() + shard_size - 1) / shard_size;
+      partials_.resize(shards);
+      // Each `Local` belongs to exactly one shard, so it still has a single
+      // Updater.
+      sharded_collect_.executor(
+          shards, [this, shard_size, &unread](size_t shard) {
+            const size_t end =
+                std::min((shard + 1) * shard_size, collect_.size());
+            size_t shard_unread = 0;
+            for (size_t i = shard * shard_size; i < end; i++) {
+              CollectFrom(*collect_[i], partials_[shard], shard_unread);
+            }
+            unread.fetch_add(shard_unread, std::memory_order_relaxed);
+          });
+      // Combine the partial values pairwise in parallel too, halving their
+      // number in each round.
+      for (size_t stride = 1; stride < shards; stride *= 2) {
+        sharded_collect_.executor(
+            (shards - stride + 2 * stride - 1) / (2 * stride),
+            [this, stride](size_t pair) {
+              const size_t i = pair * 2 * stride;
+              MoveAndReset(partials_[i + stride], partials_[i]);
+            });
+      }
+      MoveAndReset(partials_[0], value_);
+    } else {
+      for (Local* local : collect_) {
+        CollectFrom(*local, value_, serial_unread);
+      }
+    }
+    stats_.Finish(abandoned.size() + collect_.size(),
+                  unread.load(std::memory_order_relaxed) + serial_unread);
+    SIMPLE_RCU_TRACE(CollectEnd, this, abandoned.size() + collect_.size());
+  }
+
+  // Adds the value passed by the Reader of `local`, if any, to `into` and
+  // passes the reset instance back to it. Increments `unread` if the Reader
+  // hasn't taken the previous reset instance, that is, it hasn't written
+  // anything since.
+  static void CollectFrom(Local& local, T& into, size_t& unread) {
+    unread += !local.local_rcu.ForceUpdate();
+    MoveAndReset(local.local_rcu.Update(), into);
+  }
+
+  // Adds `from` to `into` and resets `from`.
+  static void MoveAndReset(T& from, T& into) {
+    into += std::move(from);
+    ResetTraits<T>::Reset(from);
+  }
+
+  // Returns a new `Local` instance registered in `locals_`.
+  std::shared_ptr<Local> Register() ABSL_LOCKS_EXCLUDED(registry_lock_) {
+    auto local = std::make_shared<Local>();
+    absl::MutexLock registry(&registry_lock_);
+    locals_.push_back(local);
+    return local;
+  }
+
+  const ShardedCollect sharded_collect_;
+  // Serializes collecting values from `View` instances.
   absl::Mutex lock_;
   // The current value that has been collected from all thread-`View`
   // instances.
   T value_ ABSL_GUARDED_BY(lock_);
-  // List of registered thread-`View` instances.
-  absl::flat_hash_set<View*> threads_ ABSL_GUARDED_BY(lock_);
+  // Pointers to `locals_` being collected by `Collect`. Kept here to avoid
+  // allocating a new vector on each call.
+  std::vector<Local*> collect_ ABSL_GUARDED_BY(lock_);
+  // Partial values of shards, see `ShardedCollect`.
+  std::vector<T> partials_ ABSL_GUARDED_BY(lock_);
+  // Protects `locals_` for a short time when registering a new `View`, so
+  // that `View`s don't need to wait for `lock_`.
+  // When both are acquired, `lock_` is always acquired first.
+  absl::Mutex registry_lock_ ABSL_ACQUIRED_AFTER(lock_);
+  // Registered thread-`View` instances.
+  std::vector<std::shared_ptr<Local>> locals_ ABSL_GUARDED_BY(registry_lock_);
+  // Modified only when holding `lock_`, retiring `locals_` also when holding
+  // `registry_lock_`.
+  typename StatsPolicy::Updater stats_;
 };
 
 }  // namespace simple_rcu
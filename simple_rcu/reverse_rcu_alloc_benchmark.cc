@@ -0,0 +1,82 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks tracking heap allocations made by writes to and collects from a
+// `ReverseRcu` with a container value, reported as the `allocs_per_collect`
+// counter. Kept separate from `reverse_rcu_benchmark`, since counting
+// allocations replaces the global `operator new`, see `alloc_counter.h`.
+
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/alloc_counter.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// Samples appended by writers, such as a log of latencies. Collected by
+// appending the samples of all `View`s.
+struct Samples {
+  Samples &operator+=(Samples &&other) {
+    values.insert(values.end(), other.values.begin(), other.values.end());
+    return *this;
+  }
+  // Keeps the capacity, see `ResetTraits`.
+  void clear() { values.clear(); }
+
+  std::vector<int_fast64_t> values;
+};
+
+constexpr int kWritesPerCollect = 64;
+
+void SetAllocsPerCollect(benchmark::State &state, uint64_t allocations) {
+  state.counters["allocs_per_collect"] =
+      benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+}
+
+// Alternates writes and collects in a single thread, so that
+// `ThreadAllocations()` counts both.
+template <bool kReuseResult>
+void BM_WriteAndCollectAllocations(benchmark::State &state) {
+  ReverseRcu<Samples> rcu;
+  ReverseRcu<Samples>::View local(rcu);
+  Samples result;
+  const auto round = [&]() {
+    for (int_fast64_t i = 0; i < kWritesPerCollect; i++) {
+      local.Write()->values.push_back(i);
+    }
+    if (kReuseResult) {
+      rcu.Collect(result);
+    } else {
+      result = rcu.Collect();
+    }
+    benchmark::DoNotOptimize(result.values.data());
+  };
+  // Warm up until all instances inside `rcu` have grown.
+  for (int i = 0; i < 8; i++) {
+    round();
+  }
+  const uint64_t allocations = ThreadAllocations();
+  for (auto _ : state) {
+    round();
+  }
+  SetAllocsPerCollect(state, ThreadAllocations() - allocations);
+}
+BENCHMARK_TEMPLATE(BM_WriteAndCollectAllocations, false);
+BENCHMARK_TEMPLATE(BM_WriteAndCollectAllocations, true);
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,222 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "benchmark/benchmark.h"
+#include "simple_rcu/fan_out_pool.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// A value of 1KB, all of which is combined by `Collect`.
+struct Kilobyte {
+  Kilobyte() : values() {}
+
+  Kilobyte& operator+=(Kilobyte&& other) {
+    for (size_t i = 0; i < values.size(); i++) {
+      values[i] += other.values[i];
+    }
+    return *this;
+  }
+
+  std::array<int_fast64_t, 1024 / sizeof(int_fast64_t)> values;
+};
+
+// A histogram with logarithmic buckets, a typical metric.
+struct Histogram {
+  Histogram() : buckets() {}
+
+  Histogram& operator+=(Histogram&& other) {
+    for (size_t i = 0; i < buckets.size(); i++) {
+      buckets[i] += other.buckets[i];
+    }
+    return *this;
+  }
+
+  std::array<int_fast64_t, 64> buckets;
+};
+
+// A single write operation of a benchmark, recording `i`.
+void Record(int_fast64_t& value, int_fast64_t) { value++; }
+void Record(Kilobyte& value, int_fast64_t i) {
+  value.values[i % value.values.size()]++;
+}
+void Record(Histogram& value, int_fast64_t i) {
+  int bucket = 0;
+  for (uint_fast64_t j = i; j > 1; j >>= 1) {
+    bucket++;
+  }
+  value.buckets[bucket]++;
+}
+
+// Shared state of `BM_Writes`: A RCU and an optional thread that collects
+// from it periodically.
+template <typename T>
+struct Context {
+  Context() : rcu(), finished(false), collector() {}
+  ~Context() {
+    finished.store(true);
+    if (collector.joinable()) {
+      collector.join();
+    }
+  }
+
+  ReverseRcu<T> rcu;
+  std::atomic<bool> finished;
+  std::thread collector;
+};
+
+template <typename T>
+static std::unique_ptr<Context<T>>& StaticContext() {
+  static std::unique_ptr<Context<T>> context;
+  return context;
+}
+
+// If `state.range(0)` is positive, starts a thread that calls `Collect` and
+// then sleeps for that many microseconds, repeatedly.
+template <typename T>
+static void SetupWrites(const benchmark::State& state) {
+  auto& context = StaticContext<T>();
+  context = absl::make_unique<Context<T>>();
+  const int64_t interval = state.range(0);
+  if (interval > 0) {
+    Context<T>* shared = context.get();
+    context->collector = std::thread([shared, interval]() {
+      while (!shared->finished.load()) {
+        benchmark::DoNotOptimize(shared->rcu.Collect());
+        std::this_thread::sleep_for(std::chrono::microseconds(interval));
+      }
+    });
+  }
+}
+
+template <typename T>
+static void TeardownWrites(const benchmark::State&) {
+  StaticContext<T>().reset();
+}
+
+// Measures the cost of `View::Write()` by each writer thread.
+template <typename T>
+static void BM_Writes(benchmark::State& state) {
+  typename ReverseRcu<T>::View local(StaticContext<T>()->rcu);
+  int_fast64_t i = 0;
+  for (auto _ : state) {
+    auto snapshot = local.Write();
+    Record(*snapshot, i++);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK_TEMPLATE(BM_Writes, int_fast64_t)
+    ->ThreadRange(1, 64)
+    ->Arg(0)
+    ->Arg(1000)
+    ->Arg(10)
+    ->Setup(SetupWrites<int_fast64_t>)
+    ->Teardown(TeardownWrites<int_fast64_t>);
+BENCHMARK_TEMPLATE(BM_Writes, Kilobyte)
+    ->ThreadRange(1, 64)
+    ->Arg(0)
+    ->Arg(1000)
+    ->Arg(10)
+    ->Setup(SetupWrites<Kilobyte>)
+    ->Teardown(TeardownWrites<Kilobyte>);
+BENCHMARK_TEMPLATE(BM_Writes, Histogram)
+    ->ThreadRange(1, 64)
+    ->Arg(0)
+    ->Arg(1000)
+    ->Arg(10)
+    ->Setup(SetupWrites<Histogram>)
+    ->Teardown(TeardownWrites<Histogram>);
+
+// Baselines for `BM_Writes<int_fast64_t>`.
+
+static void BM_AtomicFetchAdd(benchmark::State& state) {
+  static std::atomic<int_fast64_t> counter(0);
+  for (auto _ : state) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+BENCHMARK(BM_AtomicFetchAdd)->ThreadRange(1, 64);
+
+static void BM_MutexCounter(benchmark::State& state) {
+  static absl::Mutex lock;
+  static int_fast64_t counter = 0;
+  for (auto _ : state) {
+    absl::MutexLock mutex(&lock);
+    counter++;
+  }
+}
+BENCHMARK(BM_MutexCounter)->ThreadRange(1, 64);
+
+// Measures the latency of `Collect` from `state.range(0)` writers.
+template <typename T>
+static void BM_Collect(benchmark::State& state, ReverseRcu<T>& rcu) {
+  std::vector<std::unique_ptr<typename ReverseRcu<T>::View>> locals;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    locals.push_back(absl::make_unique<typename ReverseRcu<T>::View>(rcu));
+  }
+  int_fast64_t i = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (auto& local : locals) {
+      Record(*local->Write(), i++);
+    }
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(rcu.Collect());
+  }
+}
+
+template <typename T>
+static void BM_CollectSerial(benchmark::State& state) {
+  ReverseRcu<T> rcu;
+  BM_Collect(state, rcu);
+}
+BENCHMARK_TEMPLATE(BM_CollectSerial, int_fast64_t)
+    ->RangeMultiplier(4)
+    ->Range(1, 1024);
+BENCHMARK_TEMPLATE(BM_CollectSerial, Kilobyte)
+    ->RangeMultiplier(4)
+    ->Range(1, 1024);
+BENCHMARK_TEMPLATE(BM_CollectSerial, Histogram)
+    ->RangeMultiplier(4)
+    ->Range(1, 1024);
+
+template <typename T>
+static void BM_CollectSharded(benchmark::State& state) {
+  static FanOutPool pool(3);
+  ReverseRcu<T> rcu(typename ReverseRcu<T>::ShardedCollect{
+      /*shard_size=*/64, pool.Executor()});
+  BM_Collect(state, rcu);
+}
+BENCHMARK_TEMPLATE(BM_CollectSharded, int_fast64_t)
+    ->RangeMultiplier(4)
+    ->Range(1, 1024)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CollectSharded, Histogram)
+    ->RangeMultiplier(4)
+    ->Range(1, 1024)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace simple_rcu
@@ -15,12 +15,18 @@
 #include "simple_rcu/reverse_rcu.h"
 
 #include <memory>
+#include <thread>
+#include <vector>
 
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "simple_rcu/fan_out_pool.h"
 
 namespace simple_rcu {
 namespace {
 
+using ::testing::ElementsAre;
+
 TEST(ReverseRcuTest, WriteAndCollect) {
   ReverseRcu<int> rcu;
   ReverseRcu<int>::View local1(rcu);
@@ -54,6 +60,49 @@ TEST(ReverseRcuTest, WriteAndCollectMoveable) {
   EXPECT_EQ(rcu.Collect().value, 42) << "Should receive a moved value";
 }
 
+// Samples appended by writers, reset by `clear()`.
+struct Samples {
+  Samples& operator+=(Samples&& other) {
+    values.insert(values.end(), other.values.begin(), other.values.end());
+    return *this;
+  }
+  void clear() {
+    values.clear();
+    clears++;
+  }
+
+  std::vector<int> values;
+  int clears = 0;
+};
+
+TEST(ReverseRcuTest, ResetTraits) {
+  Samples samples;
+  samples.values.push_back(1);
+  ResetTraits<Samples>::Reset(samples);
+  EXPECT_TRUE(samples.values.empty());
+  EXPECT_EQ(samples.clears, 1) << "Must use `clear()` when available";
+  int value = 42;
+  ResetTraits<int>::Reset(value);
+  EXPECT_EQ(value, 0);
+}
+
+TEST(ReverseRcuTest, CollectIntoReusedValue) {
+  ReverseRcu<Samples> rcu;
+  ReverseRcu<Samples>::View local(rcu);
+  Samples result;
+  for (int i = 0; i < 5; i++) {
+    {
+      auto snapshot = local.Write();
+      snapshot->values.push_back(i);
+      snapshot->values.push_back(-i);
+    }
+    rcu.Collect(result);
+    EXPECT_THAT(result.values, ElementsAre(i, -i));
+  }
+  rcu.Collect(result);
+  EXPECT_TRUE(result.values.empty());
+}
+
 TEST(ReverseRcuTest, ThreadLocalWriteAndCollect) {
   static ReverseRcu<int> rcu;
   static thread_local ReverseRcu<int>::View local(rcu);
@@ -79,5 +128,83 @@ TEST(ReverseRcuTest, WriteRemainsStable) {
   EXPECT_EQ(rcu.Collect(), 0) << "The value should not be collected still";
 }
 
+TEST(ReverseRcuTest, DestroyedViewKeepsUncollectedWrites) {
+  ReverseRcu<int> rcu;
+  {
+    ReverseRcu<int>::View local(rcu);
+    *local.Write() += 1;
+    // Not passed to the collector yet, since `Collect` hasn't run in between.
+    *local.Write() += 2;
+  }
+  EXPECT_EQ(rcu.Collect(), 3) << "All values of a destroyed View must be "
+                                 "collected";
+  EXPECT_EQ(rcu.Collect(), 0);
+}
+
+TEST(ReverseRcuTest, ViewsRegisteredDuringCollect) {
+  static constexpr int kThreads = 8;
+  static constexpr int kWrites = 1000;
+  ReverseRcu<int> rcu;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&rcu]() {
+      for (int j = 0; j < kWrites; j++) {
+        ReverseRcu<int>::View local(rcu);
+        *local.Write() += 1;
+      }
+    });
+  }
+  int total = 0;
+  for (int i = 0; i < 100; i++) {
+    total += rcu.Collect();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  total += rcu.Collect();
+  EXPECT_EQ(total, kThreads * kWrites);
+}
+
+TEST(ReverseRcuTest, ShardedCollect) {
+  FanOutPool pool(3);
+  ReverseRcu<int> rcu(ReverseRcu<int>::ShardedCollect{
+      /*shard_size=*/8, pool.Executor()});
+  std::vector<std::unique_ptr<ReverseRcu<int>::View>> locals;
+  for (int i = 0; i < 100; i++) {
+    locals.push_back(std::unique_ptr<ReverseRcu<int>::View>(
+        new ReverseRcu<int>::View(rcu)));
+    *locals.back()->Write() += i;
+  }
+  EXPECT_EQ(rcu.Collect(), 99 * 100 / 2);
+  for (auto& local : locals) {
+    *local->Write() += 1;
+  }
+  EXPECT_EQ(rcu.Collect(), 100);
+}
+
+TEST(ReverseRcuTest, Stats) {
+  ReverseRcu<int, WithStats> rcu;
+  ReverseRcu<int, WithStats>::View writer(rcu);
+  {
+    ReverseRcu<int, WithStats>::View idle(rcu);
+    EXPECT_EQ(rcu.Stats().views, 2u);
+    *writer.Write() += 1;
+    *writer.Write() += 1;
+    // The second write is passed only by the next one.
+    EXPECT_EQ(rcu.Collect(), 1);
+  }
+  EXPECT_EQ(rcu.Stats().views, 1u);
+  EXPECT_EQ(rcu.Collect(), 0);
+  const RcuStats stats = rcu.Stats();
+  EXPECT_EQ(stats.views, 1u);
+  EXPECT_EQ(stats.reads, 2u);
+  EXPECT_EQ(stats.reads_with_new_value, 1u)
+      << "Only the first write must receive a value passed by Collect";
+  EXPECT_EQ(stats.updates, 2u);
+  EXPECT_EQ(stats.pushes, 4u);
+  EXPECT_EQ(stats.pushes_unread, 3u)
+      << "All but the first collect from `writer` must find it idle";
+}
+
 }  // namespace
 }  // namespace simple_rcu
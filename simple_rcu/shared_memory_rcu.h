@@ -0,0 +1,367 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_SHARED_MEMORY_RCU_H
+#define _SIMPLE_RCU_SHARED_MEMORY_RCU_H
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+
+// RCU between processes on the same host: A single updater process creates a
+// named POSIX shared-memory segment with `Create`, and reader processes
+// attach a `View` to it. So all processes share one copy of the value and one
+// updater, instead of each keeping its own.
+//
+// The segment has a fixed number of slots, each a `Local3StateRcu<T>` between
+// the updater and one `View`. Since `Local3StateRcu` refers to its instances
+// of `T` by indices rather than pointers, it works unchanged at different
+// addresses in each process. Reading is the same single atomic exchange as in
+// `Local3StateRcu::TryRead()`; updating copies the value into every slot.
+//
+// Each slot records the pid of the process owning it. A `View` whose process
+// dies without destroying it keeps its slot occupied until the updater calls
+// `ReclaimDeadViews()`. A process counts as dead once it has exited and has
+// been reaped by its parent. If its pid has been reused in the meantime, the
+// slot stays occupied until the new process exits too.
+//
+// `T` must be trivially copyable and must not contain pointers, as its copies
+// are shared by processes with different address spaces. All processes must
+// use the same definition of `T`; attaching checks only its size.
+//
+// Requires POSIX shared memory (`shm_open`).
+template <typename T>
+class SharedMemoryRcu final {
+ private:
+  struct Slot;
+  class Segment;
+
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Values must be trivially copyable to be shared between "
+                "processes");
+
+  // Reads the value of a `SharedMemoryRcu` from any process, including the
+  // updater's own. Each `View` occupies one slot of the segment. Like
+  // `Local3StateRcu`, it's thread-compatible, so callers are expected to
+  // attach a separate `View` for each reader thread.
+  class View final {
+   public:
+    // Attaches to the segment `name` created by `SharedMemoryRcu::Create`.
+    // Fails with `ResourceExhaustedError` if all its slots are occupied.
+    //
+    // Thread-safe.
+    static absl::StatusOr<std::unique_ptr<View>> Attach(
+        const std::string &name) {
+      absl::StatusOr<Segment> segment = Segment::Open(name);
+      if (!segment.ok()) {
+        return segment.status();
+      }
+      const int64_t pid = getpid();
+      for (size_t i = 0; i < segment->capacity(); i++) {
+        Slot &slot = segment->slot(i);
+        int64_t expected = kFree;
+        if (slot.owner.compare_exchange_strong(expected, pid,
+                                               std::memory_order_acq_rel)) {
+          return std::unique_ptr<View>(new View(*std::move(segment), slot));
+        }
+      }
+      return absl::ResourceExhaustedError("No free slot in " + name);
+    }
+
+    View(const View &) = delete;
+    View &operator=(const View &) = delete;
+    ~View() { slot_.owner.store(kFree, std::memory_order_release); }
+
+    // Returns the most recent value. The reference is valid until the next
+    // call to `Read()` or until this `View` is destroyed.
+    //
+    // Lock-free, doesn't allocate and doesn't make any system calls.
+    const T &Read() noexcept {
+      slot_.rcu.TryRead();
+      return slot_.rcu.Read();
+    }
+
+   private:
+    View(Segment segment, Slot &slot)
+        : segment_(std::move(segment)), slot_(slot) {}
+
+    // Keeps `slot_` mapped.
+    Segment segment_;
+    Slot &slot_;
+  };
+
+  // Creates the segment `name`, which must be a valid `shm_open` name such as
+  // "/my_config", with `capacity` slots for `View`s and the initial value
+  // `value`. A segment with the same name left by a previous updater is
+  // replaced, and `View`s attached to it keep reading its last value.
+  //
+  // The segment is removed when the returned instance is destroyed. Attached
+  // `View`s then keep reading the last value.
+  static absl::StatusOr<std::unique_ptr<SharedMemoryRcu>> Create(
+      const std::string &name, size_t capacity, const T &value) {
+    absl::StatusOr<Segment> segment = Segment::Create(name, capacity, value);
+    if (!segment.ok()) {
+      return segment.status();
+    }
+    return std::unique_ptr<SharedMemoryRcu>(
+        new SharedMemoryRcu(name, *std::move(segment), value));
+  }
+
+  SharedMemoryRcu(const SharedMemoryRcu &) = delete;
+  SharedMemoryRcu &operator=(const SharedMemoryRcu &) = delete;
+  ~SharedMemoryRcu() { shm_unlink(name_.c_str()); }
+
+  // Copies `value` into every slot and makes it available to all `View`s.
+  //
+  // Thread-safe.
+  void Update(const T &value) ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    value_ = value;
+    for (size_t i = 0; i < segment_.capacity(); i++) {
+      Local3StateRcu<T, CacheLinePaddedLayout> &rcu = segment_.slot(i).rcu;
+      rcu.Update() = value;
+      rcu.ForceUpdate();
+    }
+  }
+
+  // Frees the slots of `View`s whose processes have died, so that new `View`s
+  // can attach to them. Returns the number of freed slots. Makes a system call
+  // for each occupied slot, so it's meant to be called occasionally, for
+  // example when a reader process is known to have exited, or periodically.
+  //
+  // Thread-safe.
+  size_t ReclaimDeadViews() ABSL_LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock lock(&lock_);
+    size_t reclaimed = 0;
+    for (size_t i = 0; i < segment_.capacity(); i++) {
+      Slot &slot = segment_.slot(i);
+      int64_t owner = slot.owner.load(std::memory_order_acquire);
+      if (owner <= 0 || ProcessExists(owner) ||
+          !slot.owner.compare_exchange_strong(owner, kReclaiming,
+                                              std::memory_order_acq_rel)) {
+        continue;
+      }
+      // The process might have died in the middle of `Read()`, leaving the
+      // state of `rcu` inconsistent. No new `View` can claim the slot while
+      // it's `kReclaiming`, so it's safe to rebuild.
+      slot.rcu.~Local3StateRcu();
+      new (&slot.rcu) Local3StateRcu<T, CacheLinePaddedLayout>(value_);
+      slot.owner.store(kFree, std::memory_order_release);
+      reclaimed++;
+    }
+    return reclaimed;
+  }
+
+  // The number of `View`s attached, including those of dead processes that
+  // haven't been reclaimed yet. The result may be outdated by the time it's
+  // returned.
+  //
+  // Thread-safe.
+  size_t AttachedViews() const {
+    size_t attached = 0;
+    for (size_t i = 0; i < segment_.capacity(); i++) {
+      if (segment_.slot(i).owner.load(std::memory_order_relaxed) != kFree) {
+        attached++;
+      }
+    }
+    return attached;
+  }
+
+ private:
+  // Values of `Slot::owner` other than pids.
+  static constexpr int64_t kFree = 0;
+  static constexpr int64_t kReclaiming = -1;
+
+  struct alignas(kCacheLineSize) Slot {
+    explicit Slot(const T &value) : owner(kFree), rcu(value) {}
+
+    std::atomic<int64_t> owner;
+    Local3StateRcu<T, CacheLinePaddedLayout> rcu;
+  };
+#ifdef __cpp_lib_atomic_is_always_lock_free
+  static_assert(std::atomic<int64_t>::is_always_lock_free,
+                "Atomics in shared memory must be lock-free");
+#endif
+
+  struct Header {
+    // Set to `kMagic` once all the slots are initialized.
+    std::atomic<uint64_t> magic;
+    uint64_t value_size;
+    uint64_t capacity;
+  };
+  static constexpr uint64_t kMagic = 0x53524355534d3031;  // "SRCUSM01"
+  static constexpr size_t kSlotsOffset =
+      (sizeof(Header) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+
+  // A mapping of a whole segment: The `Header` followed by its slots.
+  // Move-only, unmaps the segment on destruction.
+  class Segment final {
+   public:
+    static absl::StatusOr<Segment> Create(const std::string &name,
+                                          size_t capacity, const T &value) {
+      shm_unlink(name.c_str());
+      const int fd =
+          shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+      if (fd < 0) {
+        return absl::ErrnoToStatus(errno, "shm_open " + name);
+      }
+      const size_t size = kSlotsOffset + capacity * sizeof(Slot);
+      if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        const int error = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        return absl::ErrnoToStatus(error, "ftruncate " + name);
+      }
+      absl::StatusOr<Segment> segment = Map(name, fd, size);
+      if (!segment.ok()) {
+        shm_unlink(name.c_str());
+        return segment.status();
+      }
+      Header *header = new (segment->base_) Header();
+      header->value_size = sizeof(T);
+      header->capacity = capacity;
+      for (size_t i = 0; i < capacity; i++) {
+        new (&segment->slot(i)) Slot(value);
+      }
+      segment->capacity_ = capacity;
+      header->magic.store(kMagic, std::memory_order_release);
+      return segment;
+    }
+
+    static absl::StatusOr<Segment> Open(const std::string &name) {
+      const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+      if (fd < 0) {
+        return absl::ErrnoToStatus(errno, "shm_open " + name);
+      }
+      struct stat st;
+      if (fstat(fd, &st) != 0) {
+        const int error = errno;
+        close(fd);
+        return absl::ErrnoToStatus(error, "fstat " + name);
+      }
+      const size_t size = static_cast<size_t>(st.st_size);
+      if (size < kSlotsOffset) {
+        close(fd);
+        return absl::UnavailableError(name + " isn't initialized yet");
+      }
+      absl::StatusOr<Segment> segment = Map(name, fd, size);
+      if (!segment.ok()) {
+        return segment.status();
+      }
+      const Header &header = *reinterpret_cast<const Header *>(segment->base_);
+      if (header.magic.load(std::memory_order_acquire) != kMagic) {
+        return absl::UnavailableError(name + " isn't initialized yet");
+      }
+      if (header.value_size != sizeof(T) ||
+          size < kSlotsOffset + header.capacity * sizeof(Slot)) {
+        return absl::FailedPreconditionError(
+            name + " was created for a different type");
+      }
+      segment->capacity_ = header.capacity;
+      return segment;
+    }
+
+    Segment(Segment &&other) noexcept
+        : base_(other.base_), size_(other.size_), capacity_(other.capacity_) {
+      other.base_ = nullptr;
+    }
+    Segment &operator=(Segment &&) = delete;
+    ~Segment() {
+      if (base_ != nullptr) {
+        munmap(base_, size_);
+      }
+    }
+
+    size_t capacity() const noexcept { return capacity_; }
+    Slot &slot(size_t i) const noexcept {
+      return *reinterpret_cast<Slot *>(static_cast<char *>(base_) +
+                                       kSlotsOffset + i * sizeof(Slot));
+    }
+
+   private:
+    Segment(void *base, size_t size) : base_(base), size_(size), capacity_(0) {}
+
+    // Maps and closes `fd`.
+    static absl::StatusOr<Segment> Map(const std::string &name, int fd,
+                                       size_t size) {
+      void *base =
+          mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      const int error = errno;
+      close(fd);
+      if (base == MAP_FAILED) {
+        return absl::ErrnoToStatus(error, "mmap " + name);
+      }
+      return Segment(base, size);
+    }
+
+    // Page-aligned, so suitably aligned for `Header` and `Slot`.
+    void *base_;
+    size_t size_;
+    size_t capacity_;
+  };
+
+  SharedMemoryRcu(std::string name, Segment segment, const T &value)
+      : name_(std::move(name)),
+        segment_(std::move(segment)),
+        lock_(),
+        value_(value) {}
+
+  static bool ProcessExists(int64_t pid) {
+    // Signal 0 only checks whether `pid` can be signalled. `EPERM` means it
+    // exists, but belongs to another user.
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+  }
+
+  const std::string name_;
+  const Segment segment_;
+  // Serializes updates of the slots. Only the updater process accesses them,
+  // but possibly from multiple threads.
+  absl::Mutex lock_;
+  // The current value, for rebuilding reclaimed slots.
+  T value_ ABSL_GUARDED_BY(lock_);
+};
+
+template <typename T>
+constexpr int64_t SharedMemoryRcu<T>::kFree;
+template <typename T>
+constexpr int64_t SharedMemoryRcu<T>::kReclaiming;
+template <typename T>
+constexpr uint64_t SharedMemoryRcu<T>::kMagic;
+template <typename T>
+constexpr size_t SharedMemoryRcu<T>::kSlotsOffset;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_SHARED_MEMORY_RCU_H
@@ -0,0 +1,163 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/shared_memory_rcu.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+struct Config {
+  int64_t version;
+  int32_t limits[4];
+};
+
+// Includes the pid, so that concurrent runs of the test don't collide.
+std::string SegmentName(const std::string &test) {
+  return "/simple_rcu_test_" + test + "_" + std::to_string(getpid());
+}
+
+// Runs `child` in a forked process and returns its exit status.
+template <typename F>
+int RunInChild(F child) {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    _exit(child());
+  }
+  int status = 0;
+  EXPECT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_TRUE(WIFEXITED(status));
+  return WEXITSTATUS(status);
+}
+
+TEST(SharedMemoryRcuTest, UpdateAndRead) {
+  const std::string name = SegmentName("update_and_read");
+  auto rcu = SharedMemoryRcu<Config>::Create(name, 2, Config{1, {10}});
+  ASSERT_TRUE(rcu.ok()) << rcu.status();
+  auto view = SharedMemoryRcu<Config>::View::Attach(name);
+  ASSERT_TRUE(view.ok()) << view.status();
+  EXPECT_EQ((*view)->Read().version, 1);
+  EXPECT_EQ((*view)->Read().limits[0], 10);
+  (*rcu)->Update(Config{2, {20}});
+  EXPECT_EQ((*view)->Read().version, 2);
+  EXPECT_EQ((*view)->Read().limits[0], 20);
+  (*rcu)->Update(Config{3, {30}});
+  (*rcu)->Update(Config{4, {40}});
+  EXPECT_EQ((*view)->Read().version, 4)
+      << "Must skip values published while not reading";
+  EXPECT_EQ((*rcu)->AttachedViews(), 1u);
+}
+
+TEST(SharedMemoryRcuTest, ReadsInOtherProcess) {
+  const std::string name = SegmentName("other_process");
+  auto rcu = SharedMemoryRcu<Config>::Create(name, 2, Config{7, {70}});
+  ASSERT_TRUE(rcu.ok()) << rcu.status();
+  EXPECT_EQ(RunInChild([&]() {
+              auto view = SharedMemoryRcu<Config>::View::Attach(name);
+              if (!view.ok()) {
+                return 1;
+              }
+              return (*view)->Read().version == 7 ? 0 : 2;
+            }),
+            0);
+  EXPECT_EQ((*rcu)->AttachedViews(), 0u)
+      << "The child's View must release its slot on destruction";
+}
+
+TEST(SharedMemoryRcuTest, ConcurrentUpdatesAreConsistent) {
+  const std::string name = SegmentName("concurrent");
+  constexpr int64_t kLast = 100000;
+  auto rcu = SharedMemoryRcu<Config>::Create(name, 2, Config{0, {0}});
+  ASSERT_TRUE(rcu.ok()) << rcu.status();
+  const pid_t pid = fork();
+  if (pid == 0) {
+    auto view = SharedMemoryRcu<Config>::View::Attach(name);
+    if (!view.ok()) {
+      _exit(1);
+    }
+    int64_t previous = 0;
+    for (;;) {
+      const Config &config = (*view)->Read();
+      if (config.limits[0] != config.version || config.version < previous) {
+        _exit(2);
+      }
+      previous = config.version;
+      if (previous == kLast) {
+        _exit(0);
+      }
+    }
+  }
+  for (int64_t i = 1; i <= kLast; i++) {
+    (*rcu)->Update(Config{i, {static_cast<int32_t>(i)}});
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0) << "Torn or out-of-order read";
+}
+
+TEST(SharedMemoryRcuTest, ReclaimsSlotsOfDeadProcesses) {
+  const std::string name = SegmentName("reclaim");
+  auto rcu = SharedMemoryRcu<Config>::Create(name, 1, Config{1, {}});
+  ASSERT_TRUE(rcu.ok()) << rcu.status();
+  EXPECT_EQ(RunInChild([&]() {
+              auto view = SharedMemoryRcu<Config>::View::Attach(name);
+              if (!view.ok()) {
+                return 1;
+              }
+              // Die without detaching.
+              _exit((*view)->Read().version == 1 ? 0 : 2);
+              return 3;
+            }),
+            0);
+  EXPECT_EQ((*rcu)->AttachedViews(), 1u);
+  EXPECT_TRUE(absl::IsResourceExhausted(
+      SharedMemoryRcu<Config>::View::Attach(name).status()));
+  (*rcu)->Update(Config{2, {}});
+  EXPECT_EQ((*rcu)->ReclaimDeadViews(), 1u);
+  EXPECT_EQ((*rcu)->AttachedViews(), 0u);
+  auto view = SharedMemoryRcu<Config>::View::Attach(name);
+  ASSERT_TRUE(view.ok()) << view.status();
+  EXPECT_EQ((*view)->Read().version, 2)
+      << "A reclaimed slot must hold the current value";
+  EXPECT_EQ((*rcu)->ReclaimDeadViews(), 0u)
+      << "Must not reclaim slots of live processes";
+}
+
+TEST(SharedMemoryRcuTest, AttachFailures) {
+  const std::string name = SegmentName("attach_failures");
+  EXPECT_TRUE(absl::IsNotFound(
+      SharedMemoryRcu<Config>::View::Attach(name).status()));
+  auto rcu = SharedMemoryRcu<Config>::Create(name, 1, Config{});
+  ASSERT_TRUE(rcu.ok()) << rcu.status();
+  EXPECT_TRUE(absl::IsFailedPrecondition(
+      SharedMemoryRcu<int64_t>::View::Attach(name).status()))
+      << "Must reject a segment with a different type";
+  rcu->reset();
+  EXPECT_TRUE(absl::IsNotFound(
+      SharedMemoryRcu<Config>::View::Attach(name).status()))
+      << "Must remove the segment on destruction";
+}
+
+}  // namespace
+}  // namespace simple_rcu
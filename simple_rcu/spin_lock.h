@@ -0,0 +1,66 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_SPIN_LOCK_H
+#define _SIMPLE_RCU_SPIN_LOCK_H
+
+#include <atomic>
+#include <thread>
+
+#include "absl/base/thread_annotations.h"
+
+namespace simple_rcu {
+
+// A minimal test-and-test-and-set lock with the `Lock`/`TryLock`/`Unlock`
+// interface of `absl::Mutex`, for use as the update lock of `CopyRcu` (see
+// `CopyRcuPolicy`).
+//
+// Acquiring and releasing an uncontended `SpinLock` is a single atomic
+// exchange and a single store, without any of the bookkeeping of a mutex. A
+// contended one yields the thread while it waits, but never blocks it. So
+// it's suitable only when the lock is held briefly, for example for updates
+// of small values with a few `View`s, and when writers rarely collide.
+//
+// Thread-safe.
+class ABSL_LOCKABLE SpinLock final {
+ public:
+  SpinLock() : locked_(false) {}
+  SpinLock(const SpinLock &) = delete;
+  SpinLock &operator=(const SpinLock &) = delete;
+
+  void Lock() noexcept ABSL_EXCLUSIVE_LOCK_FUNCTION() {
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+      // Wait without writing, so that waiters don't bounce the cache line.
+      while (locked_.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  bool TryLock() noexcept ABSL_EXCLUSIVE_TRYLOCK_FUNCTION(true) {
+    return !locked_.load(std::memory_order_relaxed) &&
+           !locked_.exchange(true, std::memory_order_acquire);
+  }
+
+  void Unlock() noexcept ABSL_UNLOCK_FUNCTION() {
+    locked_.store(false, std::memory_order_release);
+  }
+
+ private:
+  std::atomic<bool> locked_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_SPIN_LOCK_H
@@ -21,6 +21,7 @@
 #include "absl/base/optimization.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/absl_check.h"
+#include "simple_rcu/tracing.h"
 
 namespace simple_rcu {
 
@@ -96,6 +97,7 @@ class ThreadLocal {
   static int CleanUp() noexcept {
     int deleted_count = 0;
     auto &map = Map();
+    SIMPLE_RCU_TRACE(CleanUpBegin, &map, map.size());
     for (auto it = map.begin(); it != map.end();) {
       if (it->second.shared.expired()) {
         map.erase(it++);
@@ -104,6 +106,7 @@ class ThreadLocal {
         it++;
       }
     }
+    SIMPLE_RCU_TRACE(CleanUpEnd, &map, deleted_count);
     return deleted_count;
   }
 
@@ -0,0 +1,146 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_TRACING_H
+#define _SIMPLE_RCU_TRACING_H
+
+#include <atomic>
+#include <cstdint>
+
+// Compile-time optional tracing hooks on the hot paths of RCU operations.
+//
+// By default `SIMPLE_RCU_TRACE` expands to nothing (and doesn't evaluate its
+// arguments), so the traced code compiles exactly as without the hooks.
+// Tracing is enabled by defining one of (for example by configuring with
+// `cmake -DSIMPLE_RCU_TRACING=SINK` or `=USDT`):
+//
+// - `SIMPLE_RCU_TRACING`: Each hook calls the function installed by
+//   `SetTraceSink`, if any. Costs an atomic load and a branch per hook when
+//   no sink is installed.
+// - `SIMPLE_RCU_TRACING_USDT`: Each hook is a USDT probe `simple_rcu:<Event>`
+//   with arguments `object` and `arg` (see `TraceEvent`), for `perf`,
+//   `bpftrace` and similar tools. A probe costs a single `nop` until it's
+//   attached to. Requires `<sys/sdt.h>` (for example from package
+//   `systemtap-sdt-dev`).
+//
+// The macro must be defined consistently in all translation units of a
+// program, since it changes the definitions of inline functions.
+#if defined(SIMPLE_RCU_TRACING_USDT)
+#include <sys/sdt.h>
+#define SIMPLE_RCU_TRACE(event, object, arg) \
+  STAP_PROBE2(simple_rcu, event, object, arg)
+#elif defined(SIMPLE_RCU_TRACING)
+#define SIMPLE_RCU_TRACE(event, object, arg)                           \
+  ::simple_rcu::tracing_internal::Emit(::simple_rcu::TraceEvent::k##event, \
+                                       object, arg)
+#else
+#define SIMPLE_RCU_TRACE(event, object, arg) static_cast<void>(0)
+#endif
+
+namespace simple_rcu {
+
+// Points traced by `SIMPLE_RCU_TRACE`. Each event passes an `object` (the
+// traced instance) and an integer `arg`. Events of a `...Begin`/`...End` pair
+// are emitted by the same thread with the same `object`, so a sink can, for
+// example, measure the time between them.
+enum class TraceEvent {
+  // `CopyRcu<T>::View::Read()` or `ReadPtr()` for `View` `object`, with `arg`
+  // being the nesting depth of its snapshots before the call. Only the
+  // outermost read (`arg == 0`) advances to a new value.
+  kReadBegin,
+  // The read has finished, with `arg` being the version of its value.
+  kReadEnd,
+  // A snapshot of `View` `object` has been released, with `arg` being the
+  // remaining nesting depth of its snapshots.
+  kSnapshotRelease,
+  // An update starts passing a value to the state `object` of a `View`.
+  kPushBegin,
+  // The value has been passed, with `arg` being 1 if the `View` has read the
+  // previous value, 0 otherwise.
+  kPushEnd,
+  // `ReverseRcu<T>::Collect` of `object` starts collecting from its `View`s.
+  kCollectBegin,
+  // The values have been collected, with `arg` being the number of `View`s.
+  kCollectEnd,
+  // `ThreadLocal::CleanUp()` starts scanning the map `object` of the current
+  // thread, with `arg` being its size.
+  kCleanUpBegin,
+  // The map has been scanned, with `arg` being the number of deleted entries.
+  kCleanUpEnd,
+};
+
+// Returns the name of `event` without the `k` prefix, such as `"ReadBegin"`.
+// Matches the name of the respective USDT probe.
+inline const char *TraceEventName(TraceEvent event) noexcept {
+  switch (event) {
+    case TraceEvent::kReadBegin:
+      return "ReadBegin";
+    case TraceEvent::kReadEnd:
+      return "ReadEnd";
+    case TraceEvent::kSnapshotRelease:
+      return "SnapshotRelease";
+    case TraceEvent::kPushBegin:
+      return "PushBegin";
+    case TraceEvent::kPushEnd:
+      return "PushEnd";
+    case TraceEvent::kCollectBegin:
+      return "CollectBegin";
+    case TraceEvent::kCollectEnd:
+      return "CollectEnd";
+    case TraceEvent::kCleanUpBegin:
+      return "CleanUpBegin";
+    case TraceEvent::kCleanUpEnd:
+      return "CleanUpEnd";
+  }
+  return "Unknown";
+}
+
+// Receives events when built with `SIMPLE_RCU_TRACING`. Called on the hot
+// paths of the traced operations, so it should be fast. It must be
+// thread-safe and must not call traced operations itself.
+using TraceSink = void (*)(TraceEvent event, const void *object,
+                           uint_fast64_t arg);
+
+namespace tracing_internal {
+
+inline std::atomic<TraceSink> &Sink() noexcept {
+  // Constant-initialized, so no guard is needed.
+  static std::atomic<TraceSink> sink(nullptr);
+  return sink;
+}
+
+inline void Emit(TraceEvent event, const void *object,
+                 uint_fast64_t arg) noexcept {
+  const TraceSink sink = Sink().load(std::memory_order_acquire);
+  if (sink != nullptr) {
+    sink(event, object, arg);
+  }
+}
+
+}  // namespace tracing_internal
+
+// Installs `sink` to receive all events from now on, replacing the previous
+// one, or removes it if `nullptr`. A concurrently emitted event might still
+// reach the previous sink, so it should remain callable.
+//
+// Has no effect unless built with `SIMPLE_RCU_TRACING`.
+//
+// Thread-safe.
+inline void SetTraceSink(TraceSink sink) noexcept {
+  tracing_internal::Sink().store(sink, std::memory_order_release);
+}
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_TRACING_H
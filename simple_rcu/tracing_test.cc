@@ -0,0 +1,156 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Enables the sink in this test regardless of the build configuration, unless
+// it's configured with USDT probes.
+#if !defined(SIMPLE_RCU_TRACING) && !defined(SIMPLE_RCU_TRACING_USDT)
+#define SIMPLE_RCU_TRACING
+#endif
+
+#include "simple_rcu/tracing.h"
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "simple_rcu/copy_rcu.h"
+#include "simple_rcu/reverse_rcu.h"
+#include "simple_rcu/thread_local.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+struct Traced {
+  TraceEvent event;
+  const void *object;
+  uint_fast64_t arg;
+
+  friend bool operator==(const Traced &a, const Traced &b) {
+    return a.event == b.event && a.object == b.object && a.arg == b.arg;
+  }
+  friend void PrintTo(const Traced &traced, std::ostream *os) {
+    *os << TraceEventName(traced.event) << "(" << traced.object << ", "
+        << traced.arg << ")";
+  }
+};
+
+// All operations in these tests run on the main thread.
+std::vector<Traced> &Recorded() {
+  static std::vector<Traced> recorded;
+  return recorded;
+}
+
+void Record(TraceEvent event, const void *object, uint_fast64_t arg) {
+  Recorded().push_back(Traced{event, object, arg});
+}
+
+class TracingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+#ifdef SIMPLE_RCU_TRACING_USDT
+    GTEST_SKIP() << "Configured with USDT probes instead of a sink";
+#endif
+    SetTraceSink(&Record);
+  }
+  void TearDown() override {
+    SetTraceSink(nullptr);
+    Recorded().clear();
+  }
+};
+
+TEST_F(TracingTest, ReadAndRelease) {
+  CopyRcu<int> rcu(1);
+  CopyRcu<int>::View view(rcu);
+  {
+    auto outer = view.Read();
+    auto inner = view.Read();
+  }
+  // The initial value has version 0.
+  EXPECT_THAT(Recorded(),
+              ElementsAre(Traced{TraceEvent::kReadBegin, &view, 0},
+                          Traced{TraceEvent::kReadEnd, &view, 0},
+                          Traced{TraceEvent::kReadBegin, &view, 1},
+                          Traced{TraceEvent::kReadEnd, &view, 0},
+                          Traced{TraceEvent::kSnapshotRelease, &view, 1},
+                          Traced{TraceEvent::kSnapshotRelease, &view, 0}));
+}
+
+TEST_F(TracingTest, UpdatePushesToEachView) {
+  CopyRcu<int> rcu(1);
+  CopyRcu<int>::View view1(rcu);
+  CopyRcu<int>::View view2(rcu);
+  rcu.Update(2);
+  ASSERT_EQ(Recorded().size(), 4u);
+  const void *local = Recorded()[0].object;
+  EXPECT_NE(local, nullptr);
+  EXPECT_EQ(Recorded()[0], (Traced{TraceEvent::kPushBegin, local, 0}));
+  EXPECT_EQ(Recorded()[1], (Traced{TraceEvent::kPushEnd, local, 1}))
+      << "The View has read the previous value";
+  EXPECT_EQ(Recorded()[2].event, TraceEvent::kPushBegin);
+  EXPECT_NE(Recorded()[2].object, local) << "Must trace each View separately";
+  EXPECT_EQ(Recorded()[3].event, TraceEvent::kPushEnd);
+  Recorded().clear();
+  rcu.Update(3);
+  ASSERT_EQ(Recorded().size(), 4u);
+  EXPECT_EQ(Recorded()[1].arg, 0u) << "The View hasn't read the value";
+  EXPECT_EQ(Recorded()[3].arg, 0u) << "The View hasn't read the value";
+}
+
+TEST_F(TracingTest, Collect) {
+  ReverseRcu<int> rcu;
+  ReverseRcu<int>::View view1(rcu);
+  ReverseRcu<int>::View view2(rcu);
+  *view1.Write() += 1;
+  EXPECT_EQ(rcu.Collect(), 1);
+  EXPECT_THAT(Recorded(),
+              ElementsAre(Traced{TraceEvent::kCollectBegin, &rcu, 0},
+                          Traced{TraceEvent::kCollectEnd, &rcu, 2}));
+}
+
+TEST_F(TracingTest, CleanUp) {
+  auto shared = std::make_shared<int>(0);
+  ThreadLocal<int, int>::Get(shared, 1);
+  shared.reset();
+  EXPECT_EQ((ThreadLocal<int, int>::CleanUp()), 1);
+  ASSERT_EQ(Recorded().size(), 2u);
+  EXPECT_EQ(Recorded()[0].event, TraceEvent::kCleanUpBegin);
+  EXPECT_EQ(Recorded()[0].arg, 1u);
+  EXPECT_EQ(Recorded()[1], (Traced{TraceEvent::kCleanUpEnd,
+                                   Recorded()[0].object, 1}));
+}
+
+TEST_F(TracingTest, RemovedSinkReceivesNothing) {
+  SetTraceSink(nullptr);
+  CopyRcu<int> rcu(1);
+  CopyRcu<int>::View view(rcu);
+  rcu.Update(2);
+  EXPECT_EQ(*view.Read(), 2);
+  EXPECT_THAT(Recorded(), IsEmpty());
+}
+
+TEST(TraceEventNameTest, MatchesProbeNames) {
+  EXPECT_EQ(std::string(TraceEventName(TraceEvent::kReadBegin)), "ReadBegin");
+  EXPECT_EQ(std::string(TraceEventName(TraceEvent::kCleanUpEnd)),
+            "CleanUpEnd");
+}
+
+}  // namespace
+}  // namespace simple_rcu